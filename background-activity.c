@@ -0,0 +1,340 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-activity.c: Tells when nobody can see the desktop.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-activity.h"
+
+/* GNOME's, and the one most other desktops implement */
+static const struct {
+	const char *name;
+	const char *path;
+} screensavers[] = {
+	{ "org.gnome.ScreenSaver", "/org/gnome/ScreenSaver" },
+	{ "org.freedesktop.ScreenSaver", "/org/freedesktop/ScreenSaver" },
+};
+
+enum {
+	PROP_WIDGET = 1,
+	PROP_SCREENSAVER_ACTIVE,
+	PROP_OBSCURED,
+	PROP_SUSPENDED,
+	NUM_PROPERTIES
+};
+
+struct NautilusBackgroundActivityDetails {
+	GtkWidget *widget;
+	gulong visibility_id;
+
+	GDBusProxy *proxies[G_N_ELEMENTS (screensavers)];
+	GCancellable *cancellable;
+
+	gboolean screensaver_active;
+	gboolean obscured;
+	gboolean suspended;
+};
+
+G_DEFINE_TYPE (NautilusBackgroundActivity, nautilus_background_activity, G_TYPE_OBJECT);
+
+static void
+update_suspended (NautilusBackgroundActivity *activity)
+{
+	gboolean suspended;
+
+	suspended = activity->details->screensaver_active || activity->details->obscured;
+	if (suspended != activity->details->suspended) {
+		activity->details->suspended = suspended;
+		g_debug ("Desktop background %s", suspended ? "suspended" : "resumed");
+		g_object_notify (G_OBJECT (activity), "suspended");
+	}
+}
+
+static void
+set_screensaver_active (NautilusBackgroundActivity *activity,
+			gboolean active)
+{
+	if (active != activity->details->screensaver_active) {
+		activity->details->screensaver_active = active;
+		g_object_notify (G_OBJECT (activity), "screensaver-active");
+		update_suspended (activity);
+	}
+}
+
+static void
+on_screensaver_signal (GDBusProxy *proxy,
+		       const char *sender_name,
+		       const char *signal_name,
+		       GVariant *parameters,
+		       NautilusBackgroundActivity *activity)
+{
+	gboolean active;
+
+	if (g_strcmp0 (signal_name, "ActiveChanged") == 0 &&
+	    g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(b)"))) {
+		g_variant_get (parameters, "(b)", &active);
+		set_screensaver_active (activity, active);
+	}
+}
+
+static void
+get_active_cb (GObject *source_object,
+	       GAsyncResult *result,
+	       gpointer user_data)
+{
+	NautilusBackgroundActivity *activity;
+	GVariant *value;
+	gboolean active;
+
+	/* Gone, or the service isn't there */
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), result, NULL);
+	if (value == NULL) {
+		return;
+	}
+
+	activity = user_data;
+	if (g_variant_is_of_type (value, G_VARIANT_TYPE ("(b)"))) {
+		g_variant_get (value, "(b)", &active);
+		set_screensaver_active (activity, active);
+	}
+	g_variant_unref (value);
+}
+
+static void
+proxy_ready_cb (GObject *source_object,
+		GAsyncResult *result,
+		gpointer user_data)
+{
+	NautilusBackgroundActivity *activity;
+	GDBusProxy *proxy;
+	guint i;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (result, NULL);
+	if (proxy == NULL) {
+		return;
+	}
+
+	activity = user_data;
+	for (i = 0; i < G_N_ELEMENTS (screensavers); i++) {
+		if (activity->details->proxies[i] == NULL &&
+		    g_strcmp0 (g_dbus_proxy_get_name (proxy), screensavers[i].name) == 0) {
+			activity->details->proxies[i] = proxy;
+			break;
+		}
+	}
+
+	g_signal_connect (proxy, "g-signal",
+			  G_CALLBACK (on_screensaver_signal), activity);
+	g_dbus_proxy_call (proxy, "GetActive", NULL,
+			   G_DBUS_CALL_FLAGS_NO_AUTO_START, -1,
+			   activity->details->cancellable,
+			   get_active_cb, activity);
+}
+
+static gboolean
+on_visibility_notify (GtkWidget *widget,
+		      GdkEventVisibility *event,
+		      NautilusBackgroundActivity *activity)
+{
+	gboolean obscured;
+
+	obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+	if (obscured != activity->details->obscured) {
+		activity->details->obscured = obscured;
+		g_object_notify (G_OBJECT (activity), "obscured");
+		update_suspended (activity);
+	}
+
+	return FALSE;
+}
+
+static void
+nautilus_background_activity_constructed (GObject *object)
+{
+	NautilusBackgroundActivity *activity;
+	guint i;
+
+	activity = NAUTILUS_BACKGROUND_ACTIVITY (object);
+
+	G_OBJECT_CLASS (nautilus_background_activity_parent_class)->constructed (object);
+
+	activity->details->visibility_id =
+		g_signal_connect (activity->details->widget, "visibility-notify-event",
+				  G_CALLBACK (on_visibility_notify), activity);
+
+	activity->details->cancellable = g_cancellable_new ();
+	for (i = 0; i < G_N_ELEMENTS (screensavers); i++) {
+		g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
+					  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+					  G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+					  NULL,
+					  screensavers[i].name,
+					  screensavers[i].path,
+					  screensavers[i].name,
+					  activity->details->cancellable,
+					  proxy_ready_cb, activity);
+	}
+}
+
+static void
+nautilus_background_activity_dispose (GObject *object)
+{
+	NautilusBackgroundActivity *activity;
+	guint i;
+
+	activity = NAUTILUS_BACKGROUND_ACTIVITY (object);
+
+	if (activity->details->cancellable != NULL) {
+		g_cancellable_cancel (activity->details->cancellable);
+		g_clear_object (&activity->details->cancellable);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (screensavers); i++) {
+		if (activity->details->proxies[i] != NULL) {
+			g_signal_handlers_disconnect_by_func (activity->details->proxies[i],
+							      on_screensaver_signal, activity);
+			g_clear_object (&activity->details->proxies[i]);
+		}
+	}
+
+	if (activity->details->widget != NULL) {
+		g_signal_handler_disconnect (activity->details->widget,
+					     activity->details->visibility_id);
+		g_object_remove_weak_pointer (G_OBJECT (activity->details->widget),
+					      (gpointer *) &activity->details->widget);
+		activity->details->widget = NULL;
+	}
+
+	G_OBJECT_CLASS (nautilus_background_activity_parent_class)->dispose (object);
+}
+
+static void
+nautilus_background_activity_set_property (GObject *object,
+					   guint property_id,
+					   const GValue *value,
+					   GParamSpec *pspec)
+{
+	NautilusBackgroundActivity *activity;
+
+	activity = NAUTILUS_BACKGROUND_ACTIVITY (object);
+
+	switch (property_id) {
+	case PROP_WIDGET:
+		activity->details->widget = g_value_get_object (value);
+		g_object_add_weak_pointer (G_OBJECT (activity->details->widget),
+					   (gpointer *) &activity->details->widget);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+		break;
+	}
+}
+
+static void
+nautilus_background_activity_get_property (GObject *object,
+					   guint property_id,
+					   GValue *value,
+					   GParamSpec *pspec)
+{
+	NautilusBackgroundActivity *activity;
+
+	activity = NAUTILUS_BACKGROUND_ACTIVITY (object);
+
+	switch (property_id) {
+	case PROP_SCREENSAVER_ACTIVE:
+		g_value_set_boolean (value, activity->details->screensaver_active);
+		break;
+	case PROP_OBSCURED:
+		g_value_set_boolean (value, activity->details->obscured);
+		break;
+	case PROP_SUSPENDED:
+		g_value_set_boolean (value, activity->details->suspended);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+		break;
+	}
+}
+
+static void
+nautilus_background_activity_class_init (NautilusBackgroundActivityClass *klass)
+{
+	GObjectClass *object_class;
+	GParamSpec *pspec;
+
+	object_class = G_OBJECT_CLASS (klass);
+	object_class->constructed = nautilus_background_activity_constructed;
+	object_class->dispose = nautilus_background_activity_dispose;
+	object_class->set_property = nautilus_background_activity_set_property;
+	object_class->get_property = nautilus_background_activity_get_property;
+
+	pspec = g_param_spec_object ("widget", "Widget",
+				     "The desktop window whose visibility is watched",
+				     GTK_TYPE_WIDGET,
+				     G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+	g_object_class_install_property (object_class, PROP_WIDGET, pspec);
+
+	pspec = g_param_spec_boolean ("screensaver-active", "Screensaver active",
+				      "Whether the screen is blanked or locked",
+				      FALSE,
+				      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	g_object_class_install_property (object_class, PROP_SCREENSAVER_ACTIVE, pspec);
+
+	pspec = g_param_spec_boolean ("obscured", "Obscured",
+				      "Whether the desktop window is fully covered",
+				      FALSE,
+				      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	g_object_class_install_property (object_class, PROP_OBSCURED, pspec);
+
+	pspec = g_param_spec_boolean ("suspended", "Suspended",
+				      "Whether nobody can see the desktop",
+				      FALSE,
+				      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	g_object_class_install_property (object_class, PROP_SUSPENDED, pspec);
+
+	g_type_class_add_private (klass, sizeof (NautilusBackgroundActivityDetails));
+}
+
+static void
+nautilus_background_activity_init (NautilusBackgroundActivity *activity)
+{
+	activity->details =
+		G_TYPE_INSTANCE_GET_PRIVATE (activity,
+					     NAUTILUS_TYPE_BACKGROUND_ACTIVITY,
+					     NautilusBackgroundActivityDetails);
+}
+
+NautilusBackgroundActivity *
+nautilus_background_activity_new (GtkWidget *widget)
+{
+	return g_object_new (NAUTILUS_TYPE_BACKGROUND_ACTIVITY,
+			     "widget", widget,
+			     NULL);
+}
+
+gboolean
+nautilus_background_activity_is_suspended (NautilusBackgroundActivity *activity)
+{
+	g_return_val_if_fail (NAUTILUS_IS_BACKGROUND_ACTIVITY (activity), FALSE);
+
+	return activity->details->suspended;
+}
@@ -0,0 +1,66 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-activity.h: Tells when nobody can see the desktop.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_ACTIVITY_H__
+#define __NAUTILUS_BACKGROUND_ACTIVITY_H__
+
+#include <gtk/gtk.h>
+
+typedef struct NautilusBackgroundActivity NautilusBackgroundActivity;
+typedef struct NautilusBackgroundActivityClass NautilusBackgroundActivityClass;
+
+#define NAUTILUS_TYPE_BACKGROUND_ACTIVITY nautilus_background_activity_get_type()
+#define NAUTILUS_BACKGROUND_ACTIVITY(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_BACKGROUND_ACTIVITY, NautilusBackgroundActivity))
+#define NAUTILUS_BACKGROUND_ACTIVITY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), NAUTILUS_TYPE_BACKGROUND_ACTIVITY, NautilusBackgroundActivityClass))
+#define NAUTILUS_IS_BACKGROUND_ACTIVITY(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), NAUTILUS_TYPE_BACKGROUND_ACTIVITY))
+#define NAUTILUS_IS_BACKGROUND_ACTIVITY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), NAUTILUS_TYPE_BACKGROUND_ACTIVITY))
+#define NAUTILUS_BACKGROUND_ACTIVITY_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_BACKGROUND_ACTIVITY, NautilusBackgroundActivityClass))
+
+typedef struct NautilusBackgroundActivityDetails NautilusBackgroundActivityDetails;
+
+struct NautilusBackgroundActivity {
+	GObject parent;
+	NautilusBackgroundActivityDetails *details;
+};
+
+struct NautilusBackgroundActivityClass {
+	GObjectClass parent_class;
+};
+
+/* The desktop can't be seen while the screensaver is active, which
+ * covers both a blanked and a locked screen, or while @widget is
+ * fully covered by other windows. "suspended" is TRUE in either case
+ * and is notified when that changes.
+ */
+GType                       nautilus_background_activity_get_type     (void);
+NautilusBackgroundActivity *nautilus_background_activity_new          (GtkWidget                  *widget);
+gboolean                    nautilus_background_activity_is_suspended (NautilusBackgroundActivity *activity);
+
+#endif /* __NAUTILUS_BACKGROUND_ACTIVITY_H__ */
@@ -0,0 +1,599 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-animation.c: Plays animated pictures on the desktop.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-animation.h"
+#include "background-stats.h"
+#include "background-xshm.h"
+
+/* Frames are decoded ahead into this many slots at most */
+#define MAX_SLOTS 8
+
+/* Browsers show GIF frames at least this long, in milliseconds;
+ * shorter delays in the file are mostly mistakes.
+ */
+#define MIN_FRAME_DELAY 20
+
+/* A decoded frame and how long it stays up, -1 for good */
+typedef struct {
+	cairo_surface_t *image;
+	gint64 duration;
+} Slot;
+
+struct NautilusBackgroundAnimationDetails {
+	GdkWindow *window;
+	char *filename;
+	GDesktopBackgroundStyle placement;
+	double red, green, blue;
+	int width;
+	int height;
+	int n_areas;
+	GdkRectangle *areas;
+
+	/* The decoder fills slots after the ready ones, the frame
+	 * clock takes them from head. Both under lock.
+	 */
+	GMutex lock;
+	GCond cond;
+	Slot slots[MAX_SLOTS];
+	guint n_slots;
+	guint head;
+	guint n_ready;
+	gboolean paused;
+	gboolean stopping;
+	/* Nothing more is coming: the last frame stays up for good,
+	 * the animation doesn't loop, or it couldn't be decoded.
+	 */
+	gboolean done;
+	GThread *thread;
+
+	/* On the server, the window's background from the first frame */
+	cairo_surface_t *target;
+	gboolean showing;
+	GdkFrameClock *frame_clock;
+	gulong update_id;
+	gint64 next_time;
+	guint wake_id;
+};
+
+G_DEFINE_TYPE (NautilusBackgroundAnimation, nautilus_background_animation, G_TYPE_OBJECT);
+
+gboolean
+nautilus_background_animation_can_animate (const char *filename)
+{
+	GdkPixbufFormat *format;
+	char *name;
+	gboolean animated;
+
+	if (filename == NULL) {
+		return FALSE;
+	}
+
+	format = gdk_pixbuf_get_file_info (filename, NULL, NULL);
+	if (format == NULL) {
+		return FALSE;
+	}
+
+	/* The loaders that can give more than one frame */
+	name = gdk_pixbuf_format_get_name (format);
+	animated = g_strcmp0 (name, "gif") == 0 ||
+		   g_strcmp0 (name, "webp") == 0 ||
+		   g_strcmp0 (name, "ani") == 0;
+	g_free (name);
+
+	return animated;
+}
+
+/* Same placement as the still render, but with cairo's own filter:
+ * it costs the same for every frame, however the clip was made.
+ */
+static void
+draw_frame (NautilusBackgroundAnimation *animation,
+	    cairo_surface_t *image,
+	    GdkPixbuf *pixbuf)
+{
+	NautilusBackgroundAnimationDetails *details;
+	cairo_t *cr;
+	double scale_x, scale_y, x, y;
+	int i, width, height;
+
+	details = animation->details;
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+
+	cr = cairo_create (image);
+	cairo_set_source_rgb (cr, details->red, details->green, details->blue);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+	for (i = 0; i < details->n_areas; i++) {
+		const GdkRectangle *area = &details->areas[i];
+
+		scale_x = (double) area->width / width;
+		scale_y = (double) area->height / height;
+
+		switch (details->placement) {
+		case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+		case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+			scale_x = scale_y = MAX (scale_x, scale_y);
+			break;
+		case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+			scale_x = scale_y = MIN (scale_x, scale_y);
+			break;
+		case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+			break;
+		default:
+			scale_x = scale_y = 1.0;
+			break;
+		}
+
+		/* Tiles start at the top left corner, the rest is centered */
+		if (details->placement == G_DESKTOP_BACKGROUND_STYLE_WALLPAPER) {
+			x = area->x;
+			y = area->y;
+		} else {
+			x = area->x + (area->width - width * scale_x) / 2;
+			y = area->y + (area->height - height * scale_y) / 2;
+		}
+
+		cairo_save (cr);
+		cairo_rectangle (cr, area->x, area->y, area->width, area->height);
+		cairo_clip (cr);
+		cairo_translate (cr, x, y);
+		cairo_scale (cr, scale_x, scale_y);
+		gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+		if (details->placement == G_DESKTOP_BACKGROUND_STYLE_WALLPAPER) {
+			cairo_pattern_set_extend (cairo_get_source (cr), CAIRO_EXTEND_REPEAT);
+		}
+		cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_GOOD);
+		cairo_paint (cr);
+		cairo_restore (cr);
+	}
+
+	cairo_destroy (cr);
+	cairo_surface_flush (image);
+}
+
+/* Fills the ring until the animation is stopped or has no frames
+ * left to give.
+ */
+static void
+decode_frames (NautilusBackgroundAnimation *animation,
+	       GdkPixbufAnimation *pixbuf_animation)
+{
+	NautilusBackgroundAnimationDetails *details = animation->details;
+	GdkPixbufAnimationIter *iter;
+	Slot *slot;
+	gint64 start;
+	int delay;
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+	GTimeVal time = { 0, 0 };
+	G_GNUC_END_IGNORE_DEPRECATIONS
+
+	/* Our own clock, so frames come out in order however long
+	 * each one took to decode.
+	 */
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+	iter = gdk_pixbuf_animation_get_iter (pixbuf_animation, &time);
+	G_GNUC_END_IGNORE_DEPRECATIONS
+
+	for (;;) {
+		g_mutex_lock (&details->lock);
+		while (!details->stopping &&
+		       (details->paused || details->n_ready == details->n_slots)) {
+			g_cond_wait (&details->cond, &details->lock);
+		}
+		if (details->stopping) {
+			g_mutex_unlock (&details->lock);
+			break;
+		}
+		slot = &details->slots[(details->head + details->n_ready) % details->n_slots];
+		g_mutex_unlock (&details->lock);
+
+		start = nautilus_background_stats_begin ();
+		draw_frame (animation, slot->image,
+			    gdk_pixbuf_animation_iter_get_pixbuf (iter));
+		nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_ANIMATION_DECODE, start);
+
+		delay = gdk_pixbuf_animation_iter_get_delay_time (iter);
+
+		g_mutex_lock (&details->lock);
+		slot->duration = delay < 0 ? -1 : MAX (delay, MIN_FRAME_DELAY) * G_TIME_SPAN_MILLISECOND;
+		details->n_ready++;
+		g_mutex_unlock (&details->lock);
+
+		if (delay < 0) {
+			break;
+		}
+
+		G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+		g_time_val_add (&time, delay * G_TIME_SPAN_MILLISECOND);
+		gdk_pixbuf_animation_iter_advance (iter, &time);
+		G_GNUC_END_IGNORE_DEPRECATIONS
+	}
+
+	g_object_unref (iter);
+}
+
+static gpointer
+decode_thread (gpointer data)
+{
+	NautilusBackgroundAnimation *animation = data;
+	GdkPixbufAnimation *pixbuf_animation;
+	GError *error = NULL;
+
+	pixbuf_animation = gdk_pixbuf_animation_new_from_file (animation->details->filename, &error);
+	if (pixbuf_animation == NULL) {
+		g_warning ("Could not load animated background: %s", error->message);
+		g_error_free (error);
+	} else {
+		/* A single picture is what the still render shows already */
+		if (!gdk_pixbuf_animation_is_static_image (pixbuf_animation)) {
+			decode_frames (animation, pixbuf_animation);
+		}
+		g_object_unref (pixbuf_animation);
+	}
+
+	g_mutex_lock (&animation->details->lock);
+	animation->details->done = TRUE;
+	g_mutex_unlock (&animation->details->lock);
+
+	return NULL;
+}
+
+static void stop_updating (NautilusBackgroundAnimation *animation);
+static void start_updating (NautilusBackgroundAnimation *animation);
+
+static gboolean
+wake_cb (gpointer data)
+{
+	NautilusBackgroundAnimation *animation = data;
+
+	animation->details->wake_id = 0;
+	start_updating (animation);
+
+	return FALSE;
+}
+
+static void
+put_frame (NautilusBackgroundAnimation *animation,
+	   cairo_surface_t *image)
+{
+	cairo_t *cr;
+
+	if (nautilus_background_xshm_put (image, animation->details->target)) {
+		return;
+	}
+
+	cr = cairo_create (animation->details->target);
+	cairo_set_source_surface (cr, image, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_BYTES_SENT,
+				       (guint64) cairo_image_surface_get_stride (image) *
+				       cairo_image_surface_get_height (image));
+}
+
+static void
+on_frame_clock_update (GdkFrameClock *frame_clock,
+		       NautilusBackgroundAnimation *animation)
+{
+	NautilusBackgroundAnimationDetails *details;
+	cairo_pattern_t *pattern;
+	gint64 now, duration, start, interval;
+	guint n_ready;
+	gboolean done;
+	Slot *slot;
+
+	details = animation->details;
+	now = gdk_frame_clock_get_frame_time (frame_clock);
+	if (now < details->next_time) {
+		return;
+	}
+
+	g_mutex_lock (&details->lock);
+	n_ready = details->n_ready;
+	done = details->done;
+	g_mutex_unlock (&details->lock);
+
+	if (n_ready == 0) {
+		if (done) {
+			stop_updating (animation);
+		} else if (details->showing) {
+			/* The decoder fell behind */
+			nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_ANIMATION_LATE_FRAMES, 1);
+		}
+		return;
+	}
+
+	/* Ready slots are left alone by the decoder */
+	slot = &details->slots[details->head];
+	start = nautilus_background_stats_begin ();
+	put_frame (animation, slot->image);
+	if (!details->showing) {
+		pattern = cairo_pattern_create_for_surface (details->target);
+		gdk_window_set_background_pattern (details->window, pattern);
+		cairo_pattern_destroy (pattern);
+		details->showing = TRUE;
+	}
+	gdk_window_invalidate_rect (details->window, NULL, FALSE);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_ANIMATION_FRAME, start);
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_ANIMATION_FRAMES, 1);
+	duration = slot->duration;
+
+	g_mutex_lock (&details->lock);
+	details->head = (details->head + 1) % details->n_slots;
+	details->n_ready--;
+	g_cond_signal (&details->cond);
+	g_mutex_unlock (&details->lock);
+
+	if (duration < 0) {
+		stop_updating (animation);
+		return;
+	}
+
+	/* Keeps the clip's pace, unless it fell a whole frame behind */
+	details->next_time = MAX (details->next_time + duration, now);
+
+	/* Long frames: let the clock rest until shortly before the next
+	 * one, rather than waking it at every refresh for nothing.
+	 */
+	gdk_frame_clock_get_refresh_info (frame_clock, now, &interval, NULL);
+	if (interval <= 0) {
+		interval = G_USEC_PER_SEC / 60;
+	}
+	if (details->next_time - now > 3 * interval) {
+		stop_updating (animation);
+		details->wake_id = g_timeout_add ((details->next_time - now - 2 * interval) / 1000,
+						  wake_cb, animation);
+	}
+}
+
+static void
+start_updating (NautilusBackgroundAnimation *animation)
+{
+	NautilusBackgroundAnimationDetails *details;
+
+	details = animation->details;
+	if (details->frame_clock != NULL || details->paused) {
+		return;
+	}
+
+	details->frame_clock = g_object_ref (gdk_window_get_frame_clock (details->window));
+	details->update_id = g_signal_connect (details->frame_clock, "update",
+					       G_CALLBACK (on_frame_clock_update), animation);
+	gdk_frame_clock_begin_updating (details->frame_clock);
+}
+
+static void
+stop_updating (NautilusBackgroundAnimation *animation)
+{
+	NautilusBackgroundAnimationDetails *details;
+
+	details = animation->details;
+
+	if (details->wake_id != 0) {
+		g_source_remove (details->wake_id);
+		details->wake_id = 0;
+	}
+
+	if (details->frame_clock != NULL) {
+		g_signal_handler_disconnect (details->frame_clock, details->update_id);
+		gdk_frame_clock_end_updating (details->frame_clock);
+		details->update_id = 0;
+		g_clear_object (&details->frame_clock);
+	}
+}
+
+static void
+nautilus_background_animation_dispose (GObject *object)
+{
+	NautilusBackgroundAnimation *animation;
+
+	animation = NAUTILUS_BACKGROUND_ANIMATION (object);
+
+	stop_updating (animation);
+
+	if (animation->details->thread != NULL) {
+		g_mutex_lock (&animation->details->lock);
+		animation->details->stopping = TRUE;
+		g_cond_signal (&animation->details->cond);
+		g_mutex_unlock (&animation->details->lock);
+
+		g_thread_join (animation->details->thread);
+		animation->details->thread = NULL;
+	}
+
+	G_OBJECT_CLASS (nautilus_background_animation_parent_class)->dispose (object);
+}
+
+static void
+nautilus_background_animation_finalize (GObject *object)
+{
+	NautilusBackgroundAnimation *animation;
+	guint i;
+
+	animation = NAUTILUS_BACKGROUND_ANIMATION (object);
+
+	for (i = 0; i < animation->details->n_slots; i++) {
+		cairo_surface_destroy (animation->details->slots[i].image);
+	}
+	g_clear_pointer (&animation->details->target, cairo_surface_destroy);
+	g_clear_object (&animation->details->window);
+	g_free (animation->details->filename);
+	g_free (animation->details->areas);
+
+	g_mutex_clear (&animation->details->lock);
+	g_cond_clear (&animation->details->cond);
+
+	G_OBJECT_CLASS (nautilus_background_animation_parent_class)->finalize (object);
+}
+
+static void
+nautilus_background_animation_class_init (NautilusBackgroundAnimationClass *klass)
+{
+	GObjectClass *object_class;
+
+	object_class = G_OBJECT_CLASS (klass);
+	object_class->dispose = nautilus_background_animation_dispose;
+	object_class->finalize = nautilus_background_animation_finalize;
+
+	g_type_class_add_private (klass, sizeof (NautilusBackgroundAnimationDetails));
+}
+
+static void
+nautilus_background_animation_init (NautilusBackgroundAnimation *animation)
+{
+	animation->details =
+		G_TYPE_INSTANCE_GET_PRIVATE (animation,
+					     NAUTILUS_TYPE_BACKGROUND_ANIMATION,
+					     NautilusBackgroundAnimationDetails);
+
+	g_mutex_init (&animation->details->lock);
+	g_cond_init (&animation->details->cond);
+}
+
+/* Same layout as the still render: one copy per monitor, unless the
+ * picture spans them all.
+ */
+static void
+get_areas (NautilusBackgroundAnimation *animation,
+	   GdkScreen *screen)
+{
+	NautilusBackgroundAnimationDetails *details;
+	int i, n_monitors;
+
+	details = animation->details;
+	n_monitors = gdk_screen_get_n_monitors (screen);
+
+	if (details->placement == G_DESKTOP_BACKGROUND_STYLE_SPANNED ||
+	    n_monitors <= 1) {
+		details->n_areas = 1;
+		details->areas = g_new (GdkRectangle, 1);
+		details->areas[0].x = 0;
+		details->areas[0].y = 0;
+		details->areas[0].width = details->width;
+		details->areas[0].height = details->height;
+		return;
+	}
+
+	details->n_areas = n_monitors;
+	details->areas = g_new (GdkRectangle, n_monitors);
+	for (i = 0; i < n_monitors; i++) {
+		gdk_screen_get_monitor_geometry (screen, i, &details->areas[i]);
+	}
+}
+
+NautilusBackgroundAnimation *
+nautilus_background_animation_new (GdkWindow *window,
+				   const char *filename,
+				   GDesktopBackgroundStyle placement,
+				   const GdkColor *color,
+				   gsize budget)
+{
+	NautilusBackgroundAnimation *animation;
+	NautilusBackgroundAnimationDetails *details;
+	GdkScreen *screen;
+	cairo_surface_t *image;
+	gsize frame_size, n_frames;
+	int width, height;
+	guint i;
+
+	g_return_val_if_fail (GDK_IS_WINDOW (window), NULL);
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	screen = gdk_window_get_screen (window);
+	width = gdk_screen_get_width (screen);
+	height = gdk_screen_get_height (screen);
+
+	/* However long the clip, this is all the memory it gets, the
+	 * target included. The ring needs two slots to decode ahead.
+	 */
+	frame_size = (gsize) cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width) * height;
+	n_frames = budget / frame_size;
+	if (n_frames < 3) {
+		g_debug ("Not animating %s, %" G_GSIZE_FORMAT " bytes hold no three frames",
+			 filename, budget);
+		return NULL;
+	}
+
+	animation = g_object_new (NAUTILUS_TYPE_BACKGROUND_ANIMATION, NULL);
+	details = animation->details;
+
+	details->window = g_object_ref (window);
+	details->filename = g_strdup (filename);
+	details->placement = placement;
+	details->red = color->red / 65535.0;
+	details->green = color->green / 65535.0;
+	details->blue = color->blue / 65535.0;
+	details->width = width;
+	details->height = height;
+	get_areas (animation, screen);
+
+	details->n_slots = MIN (n_frames - 1, MAX_SLOTS);
+
+	/* Decoded straight into memory the X server can read */
+	for (i = 0; i < details->n_slots; i++) {
+		image = nautilus_background_xshm_surface_new (screen, details->width, details->height);
+		if (image == NULL) {
+			image = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+							    details->width, details->height);
+		}
+		details->slots[i].image = image;
+	}
+
+	details->target = gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+							     details->width, details->height);
+
+	details->thread = g_thread_new ("background-animation", decode_thread, animation);
+	start_updating (animation);
+
+	g_debug ("Animating %s with %u frames of %" G_GSIZE_FORMAT " bytes ahead",
+		 filename, details->n_slots, frame_size);
+
+	return animation;
+}
+
+/* The decoder waits, and the frame clock is let go */
+void
+nautilus_background_animation_set_paused (NautilusBackgroundAnimation *animation,
+					  gboolean paused)
+{
+	g_return_if_fail (NAUTILUS_IS_BACKGROUND_ANIMATION (animation));
+
+	g_mutex_lock (&animation->details->lock);
+	animation->details->paused = paused;
+	g_cond_signal (&animation->details->cond);
+	g_mutex_unlock (&animation->details->lock);
+
+	if (paused) {
+		stop_updating (animation);
+	} else {
+		animation->details->next_time = 0;
+		start_updating (animation);
+	}
+}
@@ -0,0 +1,83 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-animation.h: Plays animated pictures on the desktop.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_ANIMATION_H__
+#define __NAUTILUS_BACKGROUND_ANIMATION_H__
+
+#include <gtk/gtk.h>
+#include <gdesktop-enums.h>
+
+typedef struct NautilusBackgroundAnimation NautilusBackgroundAnimation;
+typedef struct NautilusBackgroundAnimationClass NautilusBackgroundAnimationClass;
+
+#define NAUTILUS_TYPE_BACKGROUND_ANIMATION nautilus_background_animation_get_type()
+#define NAUTILUS_BACKGROUND_ANIMATION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_BACKGROUND_ANIMATION, NautilusBackgroundAnimation))
+#define NAUTILUS_BACKGROUND_ANIMATION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), NAUTILUS_TYPE_BACKGROUND_ANIMATION, NautilusBackgroundAnimationClass))
+#define NAUTILUS_IS_BACKGROUND_ANIMATION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), NAUTILUS_TYPE_BACKGROUND_ANIMATION))
+#define NAUTILUS_IS_BACKGROUND_ANIMATION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), NAUTILUS_TYPE_BACKGROUND_ANIMATION))
+#define NAUTILUS_BACKGROUND_ANIMATION_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_BACKGROUND_ANIMATION, NautilusBackgroundAnimationClass))
+
+/* Three 4K frames: two slots and the target */
+#define NAUTILUS_BACKGROUND_ANIMATION_DEFAULT_BUDGET (100 * 1024 * 1024)
+
+typedef struct NautilusBackgroundAnimationDetails NautilusBackgroundAnimationDetails;
+
+struct NautilusBackgroundAnimation {
+	GObject parent;
+	NautilusBackgroundAnimationDetails *details;
+};
+
+struct NautilusBackgroundAnimationClass {
+	GObjectClass parent_class;
+};
+
+/* Plays a GdkPixbufAnimation, such as an animated GIF, as the
+ * background of @window. A thread decodes frames ahead into a ring of
+ * screen-sized images and stops while the ring is full or the
+ * animation is paused. The ring and the frame on screen take at most
+ * @budget bytes; %NULL is returned when that is less than three
+ * frames, and the still picture stays. The window's frame clock puts each frame up when it is due.
+ * Frames are placed on @color the way gnome-bg places pictures.
+ */
+GType                        nautilus_background_animation_get_type   (void);
+NautilusBackgroundAnimation *nautilus_background_animation_new        (GdkWindow                   *window,
+								       const char                  *filename,
+								       GDesktopBackgroundStyle      placement,
+								       const GdkColor              *color,
+								       gsize                        budget);
+void                         nautilus_background_animation_set_paused (NautilusBackgroundAnimation *animation,
+								       gboolean                     paused);
+
+/* Cheap: looks at the file's format only. The file may still turn
+ * out to be a single picture, then the animation shows nothing.
+ */
+gboolean                     nautilus_background_animation_can_animate (const char                 *filename);
+
+#endif /* __NAUTILUS_BACKGROUND_ANIMATION_H__ */
@@ -0,0 +1,259 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-blend.c: Vectorised pixel blending for crossfades.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-blend.h"
+
+#include <string.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+/* Red and blue, then alpha and green, are blended two channels at a
+ * time in 16-bit lanes; 255 * 256 still fits.
+ */
+static inline guint32
+blend_pixel (guint32 s,
+	     guint32 e,
+	     guint alpha)
+{
+	guint32 rb, ag;
+
+	rb = ((s & 0x00ff00ff) * (256 - alpha) +
+	      (e & 0x00ff00ff) * alpha) >> 8;
+	ag = ((s >> 8) & 0x00ff00ff) * (256 - alpha) +
+	     ((e >> 8) & 0x00ff00ff) * alpha;
+
+	return (rb & 0x00ff00ff) | (ag & 0xff00ff00);
+}
+
+static void
+blend_scalar (guint32 *dest,
+	      const guint32 *start,
+	      const guint32 *end,
+	      gsize n_pixels,
+	      guint alpha)
+{
+	gsize i;
+
+	for (i = 0; i < n_pixels; i++) {
+		dest[i] = blend_pixel (start[i], end[i], alpha);
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__ ((target ("sse2")))
+static void
+blend_sse2 (guint32 *dest,
+	    const guint32 *start,
+	    const guint32 *end,
+	    gsize n_pixels,
+	    guint alpha)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i a = _mm_set1_epi16 (alpha);
+	const __m128i ia = _mm_set1_epi16 (256 - alpha);
+	__m128i s, e, lo, hi;
+	gsize i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4) {
+		s = _mm_loadu_si128 ((const __m128i *) (start + i));
+		e = _mm_loadu_si128 ((const __m128i *) (end + i));
+
+		lo = _mm_add_epi16 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (s, zero), ia),
+				    _mm_mullo_epi16 (_mm_unpacklo_epi8 (e, zero), a));
+		hi = _mm_add_epi16 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (s, zero), ia),
+				    _mm_mullo_epi16 (_mm_unpackhi_epi8 (e, zero), a));
+
+		_mm_storeu_si128 ((__m128i *) (dest + i),
+				  _mm_packus_epi16 (_mm_srli_epi16 (lo, 8),
+						    _mm_srli_epi16 (hi, 8)));
+	}
+
+	blend_scalar (dest + i, start + i, end + i, n_pixels - i, alpha);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+blend_avx2 (guint32 *dest,
+	    const guint32 *start,
+	    const guint32 *end,
+	    gsize n_pixels,
+	    guint alpha)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i a = _mm256_set1_epi16 (alpha);
+	const __m256i ia = _mm256_set1_epi16 (256 - alpha);
+	__m256i s, e, lo, hi;
+	gsize i = 0;
+
+	/* Unpack and pack both work within 128-bit lanes, so the
+	 * pixel order comes out the same as it went in.
+	 */
+	for (; i + 8 <= n_pixels; i += 8) {
+		s = _mm256_loadu_si256 ((const __m256i *) (start + i));
+		e = _mm256_loadu_si256 ((const __m256i *) (end + i));
+
+		lo = _mm256_add_epi16 (_mm256_mullo_epi16 (_mm256_unpacklo_epi8 (s, zero), ia),
+				       _mm256_mullo_epi16 (_mm256_unpacklo_epi8 (e, zero), a));
+		hi = _mm256_add_epi16 (_mm256_mullo_epi16 (_mm256_unpackhi_epi8 (s, zero), ia),
+				       _mm256_mullo_epi16 (_mm256_unpackhi_epi8 (e, zero), a));
+
+		_mm256_storeu_si256 ((__m256i *) (dest + i),
+				     _mm256_packus_epi16 (_mm256_srli_epi16 (lo, 8),
+							  _mm256_srli_epi16 (hi, 8)));
+	}
+
+	blend_scalar (dest + i, start + i, end + i, n_pixels - i, alpha);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNEL
+
+static void
+blend_neon (guint32 *dest,
+	    const guint32 *start,
+	    const guint32 *end,
+	    gsize n_pixels,
+	    guint alpha)
+{
+	uint8x16_t s, e;
+	uint16x8_t lo, hi;
+	gsize i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4) {
+		s = vld1q_u8 ((const uint8_t *) (start + i));
+		e = vld1q_u8 ((const uint8_t *) (end + i));
+
+		lo = vmulq_n_u16 (vmovl_u8 (vget_low_u8 (s)), 256 - alpha);
+		lo = vmlaq_n_u16 (lo, vmovl_u8 (vget_low_u8 (e)), alpha);
+		hi = vmulq_n_u16 (vmovl_u8 (vget_high_u8 (s)), 256 - alpha);
+		hi = vmlaq_n_u16 (hi, vmovl_u8 (vget_high_u8 (e)), alpha);
+
+		vst1q_u8 ((uint8_t *) (dest + i),
+			  vcombine_u8 (vshrn_n_u16 (lo, 8), vshrn_n_u16 (hi, 8)));
+	}
+
+	blend_scalar (dest + i, start + i, end + i, n_pixels - i, alpha);
+}
+
+#endif /* HAVE_NEON_KERNEL */
+
+typedef struct {
+	const char *name;
+	NautilusBackgroundBlendFunc func;
+	gboolean (* supported) (void);
+} BlendKernel;
+
+static gboolean
+always_supported (void)
+{
+	return TRUE;
+}
+
+#ifdef HAVE_X86_KERNELS
+static gboolean
+sse2_supported (void)
+{
+	return __builtin_cpu_supports ("sse2");
+}
+
+static gboolean
+avx2_supported (void)
+{
+	return __builtin_cpu_supports ("avx2");
+}
+#endif
+
+/* Best first */
+static const BlendKernel kernels[] = {
+#ifdef HAVE_X86_KERNELS
+	{ "avx2", blend_avx2, avx2_supported },
+	{ "sse2", blend_sse2, sse2_supported },
+#endif
+#ifdef HAVE_NEON_KERNEL
+	/* NEON is part of the target when the compiler offers it */
+	{ "neon", blend_neon, always_supported },
+#endif
+	{ "scalar", blend_scalar, always_supported },
+};
+
+static const BlendKernel *
+get_kernel (void)
+{
+	static gsize chosen = 0;
+	const char *forced;
+	gsize i;
+
+	if (g_once_init_enter (&chosen)) {
+		const BlendKernel *kernel = NULL;
+
+		forced = g_getenv ("GNOME_BACKGROUND_BLEND");
+
+		for (i = 0; i < G_N_ELEMENTS (kernels) && kernel == NULL; i++) {
+			if (forced != NULL && strcmp (forced, kernels[i].name) != 0) {
+				continue;
+			}
+			if (kernels[i].supported ()) {
+				kernel = &kernels[i];
+			}
+		}
+
+		if (kernel == NULL) {
+			g_warning ("Blend kernel '%s' is not available, using the default",
+				   forced);
+			for (i = 0; kernel == NULL; i++) {
+				if (kernels[i].supported ()) {
+					kernel = &kernels[i];
+				}
+			}
+		}
+
+		g_debug ("Using the %s blend kernel", kernel->name);
+		g_once_init_leave (&chosen, (gsize) kernel);
+	}
+
+	return (const BlendKernel *) chosen;
+}
+
+NautilusBackgroundBlendFunc
+nautilus_background_blend_get_func (void)
+{
+	return get_kernel ()->func;
+}
+
+const char *
+nautilus_background_blend_get_name (void)
+{
+	return get_kernel ()->name;
+}
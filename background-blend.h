@@ -0,0 +1,47 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-blend.h: Vectorised pixel blending for crossfades.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_BLEND_H__
+#define __NAUTILUS_BACKGROUND_BLEND_H__
+
+#include <glib.h>
+
+/* Blends @n_pixels 32-bit pixels of @start and @end into @dest.
+ * @alpha goes from 0 (all @start) to 256 (all @end). @dest may be the
+ * same buffer as @start.
+ */
+typedef void (* NautilusBackgroundBlendFunc) (guint32       *dest,
+					      const guint32 *start,
+					      const guint32 *end,
+					      gsize          n_pixels,
+					      guint          alpha);
+
+/* The fastest kernel this CPU supports, picked on first use. Set
+ * GNOME_BACKGROUND_BLEND to scalar, sse2, avx2 or neon to force one.
+ */
+NautilusBackgroundBlendFunc nautilus_background_blend_get_func (void);
+const char                 *nautilus_background_blend_get_name (void);
+
+#endif /* __NAUTILUS_BACKGROUND_BLEND_H__ */
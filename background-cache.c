@@ -0,0 +1,645 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-cache.c: On-disk cache of rendered desktop backgrounds.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+/* A full screen on a triple 4K setup is about 100 MB, so keep only
+ * the last few renders around.
+ */
+#define CACHE_MAX_ENTRIES 3
+
+/* Where Linux keeps POSIX shared memory objects */
+#define SHARED_DIR "/dev/shm"
+
+/* Shared entries nobody has looked up for this long go, however few
+ * there are
+ */
+#define SHARED_MAX_AGE (24 * 60 * 60)
+
+/* A writer takes well under this to fill an entry; one without its
+ * magic after that died on the way
+ */
+#define SHARED_WRITE_TIMEOUT 60
+
+#define CACHE_MAGIC   0x43474247 /* "GBGC" */
+#define CACHE_VERSION 1
+#define CACHE_SUFFIX  ".surface"
+
+/* Followed directly by height * stride bytes of pixel data. The
+ * header size keeps the data 16-byte aligned in the mapping.
+ */
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 format;
+	guint32 width;
+	guint32 height;
+	guint32 stride;
+	guint32 padding[2];
+} CacheHeader;
+
+static cairo_user_data_key_t mapped_file_key;
+static cairo_user_data_key_t shared_mapping_key;
+
+static volatile gint shared_store = NAUTILUS_BACKGROUND_SHARED_STORE_NONE;
+
+static char *
+get_cache_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "gnome-background", NULL);
+}
+
+static char *
+get_cache_path (const char *key)
+{
+	char *dir, *hash, *name, *path;
+
+	dir = get_cache_dir ();
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+	name = g_strconcat (hash, CACHE_SUFFIX, NULL);
+	path = g_build_filename (dir, name, NULL);
+
+	g_free (name);
+	g_free (hash);
+	g_free (dir);
+
+	return path;
+}
+
+static gboolean
+is_valid (const CacheHeader *header,
+	  gsize length)
+{
+	return length >= sizeof (CacheHeader) &&
+	       header->magic == CACHE_MAGIC &&
+	       header->version == CACHE_VERSION &&
+	       header->format == CAIRO_FORMAT_RGB24 &&
+	       header->stride == (guint32) cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, header->width) &&
+	       length == sizeof (CacheHeader) + (gsize) header->stride * header->height;
+}
+
+static cairo_surface_t *
+lookup_file (const char *key)
+{
+	GMappedFile *mapped;
+	const CacheHeader *header;
+	cairo_surface_t *surface;
+	char *path, *contents;
+	gsize length;
+
+	path = get_cache_path (key);
+	mapped = g_mapped_file_new (path, FALSE, NULL);
+
+	if (mapped == NULL) {
+		g_free (path);
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (mapped);
+	length = g_mapped_file_get_length (mapped);
+	header = (const CacheHeader *) contents;
+
+	if (!is_valid (header, length)) {
+		g_mapped_file_unref (mapped);
+		g_free (path);
+		return NULL;
+	}
+
+	/* Keep recently used entries from being pruned */
+	g_utime (path, NULL);
+	g_free (path);
+
+	/* Zero-copy: the surface points straight into the mapping,
+	 * which stays alive for as long as the surface does. The
+	 * mapping is read-only, which is fine since rendered
+	 * backgrounds are only ever used as a source.
+	 */
+	surface = cairo_image_surface_create_for_data ((unsigned char *) contents + sizeof (CacheHeader),
+						       CAIRO_FORMAT_RGB24,
+						       header->width,
+						       header->height,
+						       header->stride);
+	cairo_surface_set_user_data (surface, &mapped_file_key, mapped,
+				     (cairo_destroy_func_t) g_mapped_file_unref);
+
+	return surface;
+}
+
+static gboolean
+write_all (int fd,
+	   const guchar *data,
+	   gsize length)
+{
+	gssize written;
+
+	while (length > 0) {
+		written = write (fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		data += written;
+		length -= written;
+	}
+
+	return TRUE;
+}
+
+typedef struct {
+	char *path;
+	time_t mtime;
+} CacheEntry;
+
+static gint
+compare_mtime (gconstpointer a,
+	       gconstpointer b)
+{
+	const CacheEntry *ea = a, *eb = b;
+
+	return (ea->mtime > eb->mtime) - (ea->mtime < eb->mtime);
+}
+
+static void
+prune_cache (const char *dir)
+{
+	GDir *d;
+	const char *name;
+	GArray *entries;
+	CacheEntry entry;
+	GStatBuf buf;
+	guint i;
+
+	d = g_dir_open (dir, 0, NULL);
+	if (d == NULL) {
+		return;
+	}
+
+	entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+
+	while ((name = g_dir_read_name (d)) != NULL) {
+		if (!g_str_has_suffix (name, CACHE_SUFFIX)) {
+			continue;
+		}
+
+		entry.path = g_build_filename (dir, name, NULL);
+		if (g_stat (entry.path, &buf) != 0) {
+			g_free (entry.path);
+			continue;
+		}
+		entry.mtime = buf.st_mtime;
+		g_array_append_val (entries, entry);
+	}
+	g_dir_close (d);
+
+	/* Oldest first */
+	g_array_sort (entries, compare_mtime);
+
+	for (i = 0; i < entries->len; i++) {
+		entry = g_array_index (entries, CacheEntry, i);
+		if (i + CACHE_MAX_ENTRIES < entries->len) {
+			g_unlink (entry.path);
+		}
+		g_free (entry.path);
+	}
+
+	g_array_free (entries, TRUE);
+}
+
+static void
+store_file (const char *key,
+	    cairo_surface_t *surface)
+{
+	CacheHeader header = { 0, };
+	char *dir, *path, *tmp_path;
+	int fd;
+	gboolean ok;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    cairo_image_surface_get_format (surface) != CAIRO_FORMAT_RGB24) {
+		return;
+	}
+
+	cairo_surface_flush (surface);
+
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.format = CAIRO_FORMAT_RGB24;
+	header.width = cairo_image_surface_get_width (surface);
+	header.height = cairo_image_surface_get_height (surface);
+	header.stride = cairo_image_surface_get_stride (surface);
+
+	dir = get_cache_dir ();
+	if (g_mkdir_with_parents (dir, 0700) != 0) {
+		g_free (dir);
+		return;
+	}
+
+	path = get_cache_path (key);
+	tmp_path = g_strconcat (path, ".XXXXXX", NULL);
+
+	/* Write to a temporary and rename, so a reader never maps a
+	 * half-written file.
+	 */
+	fd = g_mkstemp (tmp_path);
+	if (fd < 0) {
+		g_free (tmp_path);
+		g_free (path);
+		g_free (dir);
+		return;
+	}
+
+	ok = write_all (fd, (const guchar *) &header, sizeof (header)) &&
+	     write_all (fd, cairo_image_surface_get_data (surface),
+			(gsize) header.stride * header.height);
+	ok = (close (fd) == 0) && ok;
+
+	if (ok && g_rename (tmp_path, path) == 0) {
+		prune_cache (dir);
+	} else {
+		g_unlink (tmp_path);
+	}
+
+	g_free (tmp_path);
+	g_free (path);
+	g_free (dir);
+}
+
+/* Shared entries are POSIX shared memory objects. There is no atomic
+ * rename for those, so a writer creates the object exclusively and
+ * sets the magic last; a reader seeing no magic treats it as a miss.
+ */
+static char *
+get_shared_prefix (void)
+{
+	if (g_atomic_int_get (&shared_store) == NAUTILUS_BACKGROUND_SHARED_STORE_USER) {
+		return g_strdup_printf ("gnome-background-%u-", (guint) getuid ());
+	} else {
+		return g_strdup ("gnome-background-");
+	}
+}
+
+static char *
+get_shared_name (const char *key)
+{
+	char *hash, *prefix, *name;
+
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+	prefix = get_shared_prefix ();
+	name = g_strdup_printf ("/%s%.32s", prefix, hash);
+	g_free (prefix);
+	g_free (hash);
+
+	return name;
+}
+
+/* Names of this store are the prefix and 32 hex digits, nothing
+ * more; the system store's prefix is also the start of every user
+ * store's.
+ */
+static gboolean
+is_shared_name (const char *name,
+		const char *prefix)
+{
+	const char *hash;
+	int i;
+
+	if (!g_str_has_prefix (name, prefix)) {
+		return FALSE;
+	}
+
+	hash = name + strlen (prefix);
+	for (i = 0; i < 32; i++) {
+		if (!g_ascii_isxdigit (hash[i])) {
+			return FALSE;
+		}
+	}
+
+	return hash[32] == '\0';
+}
+
+/* An entry whose writer died before setting the magic. It would
+ * otherwise block its key for good, as entries are created
+ * exclusively.
+ */
+static gboolean
+is_abandoned (int fd,
+	      const struct stat *buf)
+{
+	guint32 magic = 0;
+
+	if (time (NULL) - buf->st_mtime < SHARED_WRITE_TIMEOUT) {
+		return FALSE;
+	}
+
+	return buf->st_size < (off_t) sizeof (CacheHeader) ||
+	       pread (fd, &magic, sizeof (magic), 0) != sizeof (magic) ||
+	       magic != CACHE_MAGIC;
+}
+
+/* Entries outlive the processes that wrote them, for the sessions
+ * still starting up, so every process cleans up after all of them:
+ * the abandoned, those unused for a day and all but the newest few
+ * go. Whoever still maps one keeps its pages. In the system store
+ * only the owner of an entry can unlink it, the others are skipped.
+ */
+static void
+prune_shared (void)
+{
+	GDir *d;
+	const char *name;
+	GArray *entries;
+	CacheEntry entry;
+	struct stat buf;
+	char *prefix;
+	time_t now;
+	guint i;
+	int fd;
+
+	d = g_dir_open (SHARED_DIR, 0, NULL);
+	if (d == NULL) {
+		return;
+	}
+
+	prefix = get_shared_prefix ();
+	entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+	now = time (NULL);
+
+	while ((name = g_dir_read_name (d)) != NULL) {
+		if (!is_shared_name (name, prefix)) {
+			continue;
+		}
+
+		entry.path = g_strconcat ("/", name, NULL);
+		fd = shm_open (entry.path, O_RDONLY, 0);
+		if (fd < 0) {
+			g_free (entry.path);
+			continue;
+		}
+		if (fstat (fd, &buf) != 0 ||
+		    (g_atomic_int_get (&shared_store) == NAUTILUS_BACKGROUND_SHARED_STORE_USER &&
+		     buf.st_uid != getuid ())) {
+			close (fd);
+			g_free (entry.path);
+			continue;
+		}
+
+		if (is_abandoned (fd, &buf) || now - buf.st_mtime > SHARED_MAX_AGE) {
+			shm_unlink (entry.path);
+			g_free (entry.path);
+		} else {
+			entry.mtime = buf.st_mtime;
+			g_array_append_val (entries, entry);
+		}
+		close (fd);
+	}
+	g_dir_close (d);
+	g_free (prefix);
+
+	/* Oldest first */
+	g_array_sort (entries, compare_mtime);
+
+	for (i = 0; i < entries->len; i++) {
+		entry = g_array_index (entries, CacheEntry, i);
+		if (i + CACHE_MAX_ENTRIES < entries->len) {
+			shm_unlink (entry.path);
+		}
+		g_free (entry.path);
+	}
+
+	g_array_free (entries, TRUE);
+}
+
+typedef struct {
+	gpointer data;
+	gsize length;
+} SharedMapping;
+
+static void
+shared_mapping_free (SharedMapping *mapping)
+{
+	munmap (mapping->data, mapping->length);
+	g_slice_free (SharedMapping, mapping);
+}
+
+static cairo_surface_t *
+lookup_shared (const char *key)
+{
+	SharedMapping *mapping;
+	const CacheHeader *header;
+	cairo_surface_t *surface;
+	struct stat buf;
+	char *name;
+	gpointer data;
+	int fd;
+
+	name = get_shared_name (key);
+	fd = shm_open (name, O_RDONLY, 0);
+	g_free (name);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	/* The pages are read in place, so whoever owns the object can
+	 * truncate it under us. Only our own entries count, and in the
+	 * system store root's as well.
+	 */
+	if (fstat (fd, &buf) != 0 || buf.st_size < (off_t) sizeof (CacheHeader) ||
+	    (buf.st_uid != getuid () &&
+	     (g_atomic_int_get (&shared_store) == NAUTILUS_BACKGROUND_SHARED_STORE_USER ||
+	      buf.st_uid != 0))) {
+		close (fd);
+		return NULL;
+	}
+
+	data = mmap (NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close (fd);
+		return NULL;
+	}
+
+	/* Still being written */
+	header = data;
+	if (g_atomic_int_get ((gint *) &header->magic) != CACHE_MAGIC ||
+	    !is_valid (header, buf.st_size)) {
+		munmap (data, buf.st_size);
+		close (fd);
+		return NULL;
+	}
+
+	/* In use, so pruning keeps it. Only the owner may do this in
+	 * the system store, which is fine for a hint.
+	 */
+	futimens (fd, NULL);
+	close (fd);
+
+	mapping = g_slice_new (SharedMapping);
+	mapping->data = data;
+	mapping->length = buf.st_size;
+
+	surface = cairo_image_surface_create_for_data ((unsigned char *) data + sizeof (CacheHeader),
+						       CAIRO_FORMAT_RGB24,
+						       header->width,
+						       header->height,
+						       header->stride);
+	cairo_surface_set_user_data (surface, &shared_mapping_key, mapping,
+				     (cairo_destroy_func_t) shared_mapping_free);
+
+	return surface;
+}
+
+static void
+store_shared (const char *key,
+	      cairo_surface_t *surface)
+{
+	CacheHeader *header;
+	struct stat buf;
+	char *name;
+	gsize length;
+	gpointer data;
+	int fd, width, height, stride;
+	mode_t mode;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    cairo_image_surface_get_format (surface) != CAIRO_FORMAT_RGB24) {
+		return;
+	}
+
+	cairo_surface_flush (surface);
+
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	length = sizeof (CacheHeader) + (gsize) stride * height;
+
+	mode = (g_atomic_int_get (&shared_store) == NAUTILUS_BACKGROUND_SHARED_STORE_SYSTEM) ? 0644 : 0600;
+
+	/* Somebody else has it, or is writing it right now, unless
+	 * the writer died on the way; then it is written anew.
+	 */
+	name = get_shared_name (key);
+	fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, mode);
+	if (fd < 0 && errno == EEXIST) {
+		fd = shm_open (name, O_RDONLY, 0);
+		if (fd >= 0) {
+			if (fstat (fd, &buf) == 0 && is_abandoned (fd, &buf)) {
+				shm_unlink (name);
+			}
+			close (fd);
+		}
+		fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, mode);
+	}
+	if (fd < 0) {
+		g_free (name);
+		return;
+	}
+
+	/* Not subject to the umask */
+	if (fchmod (fd, mode) != 0 || ftruncate (fd, length) != 0) {
+		close (fd);
+		shm_unlink (name);
+		g_free (name);
+		return;
+	}
+
+	data = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) {
+		shm_unlink (name);
+		g_free (name);
+		return;
+	}
+
+	header = data;
+	header->version = CACHE_VERSION;
+	header->format = CAIRO_FORMAT_RGB24;
+	header->width = width;
+	header->height = height;
+	header->stride = stride;
+	memcpy ((guchar *) data + sizeof (CacheHeader),
+		cairo_image_surface_get_data (surface),
+		(gsize) stride * height);
+	g_atomic_int_set ((gint *) &header->magic, CACHE_MAGIC);
+
+	munmap (data, length);
+	g_free (name);
+
+	prune_shared ();
+}
+
+cairo_surface_t *
+nautilus_background_cache_lookup (const char *key)
+{
+	cairo_surface_t *surface;
+	gboolean shared;
+
+	shared = g_atomic_int_get (&shared_store) != NAUTILUS_BACKGROUND_SHARED_STORE_NONE;
+
+	if (shared) {
+		surface = lookup_shared (key);
+		if (surface != NULL) {
+			return surface;
+		}
+	}
+
+	/* Pass a disk hit on, so the next session maps it from memory */
+	surface = lookup_file (key);
+	if (surface != NULL && shared) {
+		store_shared (key, surface);
+	}
+
+	return surface;
+}
+
+void
+nautilus_background_cache_store (const char *key,
+				 cairo_surface_t *surface)
+{
+	if (g_atomic_int_get (&shared_store) != NAUTILUS_BACKGROUND_SHARED_STORE_NONE) {
+		store_shared (key, surface);
+	}
+	store_file (key, surface);
+}
+
+void
+nautilus_background_cache_set_shared_store (NautilusBackgroundSharedStore store)
+{
+	g_atomic_int_set (&shared_store, store);
+
+	/* Whatever earlier runs left behind */
+	if (store != NAUTILUS_BACKGROUND_SHARED_STORE_NONE) {
+		prune_shared ();
+	}
+}
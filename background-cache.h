@@ -0,0 +1,57 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-cache.h: On-disk cache of rendered desktop backgrounds.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_CACHE_H__
+#define __NAUTILUS_BACKGROUND_CACHE_H__
+
+#include <gtk/gtk.h>
+
+/* Rendered surfaces are stored raw under $XDG_CACHE_HOME, so a hit
+ * is a read-only mapping of the file and costs no decoding. @key is
+ * any string that identifies the render, it gets hashed here.
+ * Both functions are safe to call from the render thread.
+ */
+cairo_surface_t *nautilus_background_cache_lookup (const char      *key);
+void             nautilus_background_cache_store  (const char      *key,
+						   cairo_surface_t *surface);
+
+typedef enum {
+	NAUTILUS_BACKGROUND_SHARED_STORE_NONE,
+	NAUTILUS_BACKGROUND_SHARED_STORE_USER,
+	NAUTILUS_BACKGROUND_SHARED_STORE_SYSTEM,
+} NautilusBackgroundSharedStore;
+
+/* With a shared store, renders are also kept in POSIX shared memory,
+ * where every process of the same user maps the same pages instead
+ * of rendering its own copy. With NAUTILUS_BACKGROUND_SHARED_STORE_SYSTEM
+ * every user also maps what root put there. Pages are read in place,
+ * and their owner could truncate them under the reader, so entries
+ * of other users are never used. Like the disk
+ * cache, the store keeps only the newest few entries, whichever
+ * process wrote them.
+ */
+void             nautilus_background_cache_set_shared_store (NautilusBackgroundSharedStore store);
+
+#endif /* __NAUTILUS_BACKGROUND_CACHE_H__ */
@@ -0,0 +1,764 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-crossfade.c: Crossfades the desktop window between backgrounds.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-crossfade.h"
+#include "background-blend.h"
+#include "background-stats.h"
+#include "background-xrender.h"
+
+#include <cairo-xlib.h>
+
+#include <string.h>
+
+/* Same as GnomeBGCrossfade */
+#define FADE_DURATION (750 * G_TIME_SPAN_MILLISECOND)
+
+/* Granularity of the comparison between start and end */
+#define DIRTY_BLOCK_SIZE 64
+
+/* Frame budget when the frame clock doesn't know the refresh rate */
+#define DEFAULT_FRAME_BUDGET (G_USEC_PER_SEC / 60)
+
+/* Frames in a row over budget before the fade falls back a level */
+#define MISSED_FRAMES_LIMIT 3
+
+/* Alpha steps apart when stepped: 8 steps over the whole fade */
+#define STEPPED_ALPHA 32
+
+/* How much of the fade is drawn, lowered while it runs when frames
+ * take longer than the screen's refresh interval.
+ */
+typedef enum {
+	FADE_LEVEL_FULL,
+	FADE_LEVEL_STEPPED,
+	FADE_LEVEL_SKIP,
+} FadeLevel;
+
+static const char * const level_names[] = {
+	"full",
+	"stepped",
+	"skip",
+};
+
+/* What fades on this host start at. Learned from earlier fades, but
+ * never "skip", or there would be nothing left to learn from.
+ */
+static FadeLevel host_level = FADE_LEVEL_FULL;
+
+enum {
+	FINISHED,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+struct NautilusBackgroundCrossfadeDetails {
+	int width;
+	int height;
+
+	/* Blend on the X server instead of the client. Start and end
+	 * then stay where they already are, as pixmaps.
+	 */
+	gboolean use_xrender;
+
+	/* Hold on to the pixmaps only and read them back when the
+	 * fade starts, rather than keeping client-side copies around
+	 * for as long as the fade waits for its end.
+	 */
+	gboolean low_memory;
+	cairo_surface_t *start_surface;
+	Picture start_picture;
+	Picture end_picture;
+	Picture frame_picture;
+
+	/* Client-side copies the blend reads from */
+	cairo_surface_t *start_image;
+	cairo_surface_t *end_image;
+
+	/* Installed as is once the fade is over */
+	cairo_surface_t *end_surface;
+
+	/* The frame is blended on the client, then the changed parts
+	 * are copied to the server-side surface that is the window's
+	 * background while the fade runs.
+	 */
+	cairo_surface_t *frame_image;
+	cairo_surface_t *frame_surface;
+	cairo_region_t *dirty;
+
+	GdkWindow *window;
+	GdkFrameClock *frame_clock;
+	gulong update_id;
+	gint64 start_time;
+	guint last_alpha;
+
+	FadeLevel level;
+	gint64 last_frame_time;
+	guint missed_frames;
+	gboolean missed_any;
+};
+
+G_DEFINE_TYPE (NautilusBackgroundCrossfade, nautilus_background_crossfade, G_TYPE_OBJECT);
+
+static cairo_surface_t *
+copy_to_image (NautilusBackgroundCrossfade *fade,
+	       cairo_surface_t *surface)
+{
+	cairo_surface_t *image;
+	cairo_t *cr;
+
+	image = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+					    fade->details->width,
+					    fade->details->height);
+
+	cr = cairo_create (image);
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	return image;
+}
+
+static gboolean
+block_differs (cairo_surface_t *start,
+	       cairo_surface_t *end,
+	       int x,
+	       int y,
+	       int width,
+	       int height)
+{
+	const guchar *s, *e;
+	int stride, row;
+
+	stride = cairo_image_surface_get_stride (start);
+	s = cairo_image_surface_get_data (start) + y * stride + x * 4;
+	e = cairo_image_surface_get_data (end) + y * stride + x * 4;
+
+	for (row = 0; row < height; row++) {
+		if (memcmp (s, e, width * 4) != 0) {
+			return TRUE;
+		}
+		s += stride;
+		e += stride;
+	}
+
+	return FALSE;
+}
+
+/* Only blocks that differ between start and end need blending. Runs
+ * of dirty blocks on a block row are merged into one rectangle.
+ */
+static cairo_region_t *
+compute_dirty_region (NautilusBackgroundCrossfade *fade)
+{
+	cairo_region_t *region;
+	cairo_rectangle_int_t run;
+	int x, y, width, height;
+
+	cairo_surface_flush (fade->details->start_image);
+	cairo_surface_flush (fade->details->end_image);
+
+	region = cairo_region_create ();
+
+	for (y = 0; y < fade->details->height; y += DIRTY_BLOCK_SIZE) {
+		height = MIN (DIRTY_BLOCK_SIZE, fade->details->height - y);
+		run.width = 0;
+
+		for (x = 0; x < fade->details->width; x += DIRTY_BLOCK_SIZE) {
+			width = MIN (DIRTY_BLOCK_SIZE, fade->details->width - x);
+
+			if (block_differs (fade->details->start_image,
+					   fade->details->end_image,
+					   x, y, width, height)) {
+				if (run.width == 0) {
+					run.x = x;
+					run.y = y;
+					run.height = height;
+				}
+				run.width += width;
+			} else if (run.width > 0) {
+				cairo_region_union_rectangle (region, &run);
+				run.width = 0;
+			}
+		}
+
+		if (run.width > 0) {
+			cairo_region_union_rectangle (region, &run);
+		}
+	}
+
+	return region;
+}
+
+static void
+blend_frame (NautilusBackgroundCrossfade *fade,
+	     guint alpha)
+{
+	NautilusBackgroundBlendFunc blend;
+	cairo_rectangle_int_t rect;
+	guchar *frame, *start, *end;
+	gsize offset;
+	int stride, i, n, row;
+
+	blend = nautilus_background_blend_get_func ();
+
+	cairo_surface_flush (fade->details->frame_image);
+
+	stride = cairo_image_surface_get_stride (fade->details->frame_image);
+	frame = cairo_image_surface_get_data (fade->details->frame_image);
+	start = cairo_image_surface_get_data (fade->details->start_image);
+	end = cairo_image_surface_get_data (fade->details->end_image);
+
+	n = cairo_region_num_rectangles (fade->details->dirty);
+	for (i = 0; i < n; i++) {
+		cairo_region_get_rectangle (fade->details->dirty, i, &rect);
+
+		for (row = rect.y; row < rect.y + rect.height; row++) {
+			offset = (gsize) row * stride + rect.x * 4;
+			blend ((guint32 *) (frame + offset),
+			       (const guint32 *) (start + offset),
+			       (const guint32 *) (end + offset),
+			       rect.width, alpha);
+		}
+
+		cairo_surface_mark_dirty_rectangle (fade->details->frame_image,
+						    rect.x, rect.y,
+						    rect.width, rect.height);
+	}
+}
+
+static void
+upload_frame (NautilusBackgroundCrossfade *fade)
+{
+	cairo_t *cr;
+
+	cr = cairo_create (fade->details->frame_surface);
+	gdk_cairo_region (cr, fade->details->dirty);
+	cairo_clip (cr);
+	cairo_set_source_surface (cr, fade->details->frame_image, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+}
+
+static void
+set_window_background (GdkWindow *window,
+		       cairo_surface_t *surface)
+{
+	cairo_pattern_t *pattern;
+
+	pattern = cairo_pattern_create_for_surface (surface);
+	gdk_window_set_background_pattern (window, pattern);
+	cairo_pattern_destroy (pattern);
+}
+
+static void
+stop_updating (NautilusBackgroundCrossfade *fade)
+{
+	if (fade->details->frame_clock != NULL) {
+		g_signal_handler_disconnect (fade->details->frame_clock,
+					     fade->details->update_id);
+		gdk_frame_clock_end_updating (fade->details->frame_clock);
+		fade->details->update_id = 0;
+		g_clear_object (&fade->details->frame_clock);
+	}
+
+	nautilus_background_xrender_picture_free (fade->details->frame_surface,
+						  fade->details->frame_picture);
+	nautilus_background_xrender_picture_free (fade->details->start_surface,
+						  fade->details->start_picture);
+	nautilus_background_xrender_picture_free (fade->details->end_surface,
+						  fade->details->end_picture);
+	fade->details->frame_picture = None;
+	fade->details->start_picture = None;
+	fade->details->end_picture = None;
+
+	if (fade->details->frame_surface != NULL) {
+		cairo_surface_destroy (fade->details->frame_surface);
+		fade->details->frame_surface = NULL;
+	}
+	if (fade->details->frame_image != NULL) {
+		cairo_surface_destroy (fade->details->frame_image);
+		fade->details->frame_image = NULL;
+	}
+	g_clear_pointer (&fade->details->dirty, cairo_region_destroy);
+}
+
+static void
+finish (NautilusBackgroundCrossfade *fade)
+{
+	GdkWindow *window;
+
+	/* A clean run that drew something lets the next fade try one
+	 * level better.
+	 */
+	if (fade->details->last_frame_time != 0 && !fade->details->missed_any &&
+	    host_level > FADE_LEVEL_FULL && fade->details->level <= host_level) {
+		host_level--;
+		g_debug ("Crossfades back to %s", level_names[host_level]);
+	}
+
+	window = fade->details->window;
+	fade->details->window = NULL;
+
+	stop_updating (fade);
+
+	set_window_background (window, fade->details->end_surface);
+	gdk_window_invalidate_rect (window, NULL, FALSE);
+
+	g_signal_emit (fade, signals[FINISHED], 0, window);
+	g_object_unref (window);
+}
+
+static void
+fall_back (NautilusBackgroundCrossfade *fade,
+	   gint64 frame_time,
+	   gint64 budget)
+{
+	fade->details->level++;
+	fade->details->missed_frames = 0;
+
+	if (fade->details->level == FADE_LEVEL_SKIP) {
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_FADES_SKIPPED, 1);
+	} else {
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_FADES_STEPPED, 1);
+	}
+	host_level = MAX (host_level, MIN (fade->details->level, FADE_LEVEL_STEPPED));
+
+	g_debug ("Crossfade falls back to %s: %" G_GINT64_FORMAT " us frames, %" G_GINT64_FORMAT " us budget, %s",
+		 level_names[fade->details->level], frame_time, budget,
+		 fade->details->frame_picture != None ? "XRender" : "client-side");
+}
+
+/* A frame misses when drawing it takes longer than the refresh
+ * interval, or when the frame clock itself fell behind.
+ */
+static void
+check_frame_time (NautilusBackgroundCrossfade *fade,
+		  GdkFrameClock *frame_clock,
+		  gint64 now,
+		  gint64 work)
+{
+	gint64 budget, interval;
+
+	gdk_frame_clock_get_refresh_info (frame_clock, now, &budget, NULL);
+	if (budget <= 0) {
+		budget = DEFAULT_FRAME_BUDGET;
+	}
+
+	interval = (fade->details->last_frame_time != 0) ?
+		now - fade->details->last_frame_time : 0;
+	fade->details->last_frame_time = now;
+
+	if (work <= budget && interval <= 2 * budget) {
+		fade->details->missed_frames = 0;
+		return;
+	}
+
+	fade->details->missed_any = TRUE;
+	if (++fade->details->missed_frames >= MISSED_FRAMES_LIMIT) {
+		fall_back (fade, MAX (work, interval), budget);
+	}
+}
+
+static void
+on_frame_clock_update (GdkFrameClock *frame_clock,
+		       NautilusBackgroundCrossfade *fade)
+{
+	gint64 now, elapsed, start;
+	guint alpha;
+
+	now = gdk_frame_clock_get_frame_time (frame_clock);
+	if (fade->details->start_time == 0) {
+		fade->details->start_time = now;
+	}
+	elapsed = now - fade->details->start_time;
+
+	if (elapsed >= FADE_DURATION ||
+	    fade->details->level == FADE_LEVEL_SKIP ||
+	    (fade->details->dirty != NULL &&
+	     cairo_region_is_empty (fade->details->dirty))) {
+		finish (fade);
+		return;
+	}
+
+	alpha = elapsed * 256 / FADE_DURATION;
+	if (fade->details->level == FADE_LEVEL_STEPPED) {
+		alpha -= alpha % STEPPED_ALPHA;
+	}
+	if (alpha == fade->details->last_alpha) {
+		return;
+	}
+	fade->details->last_alpha = alpha;
+
+	start = nautilus_background_stats_begin ();
+	if (fade->details->frame_picture != None) {
+		nautilus_background_xrender_blend (fade->details->frame_surface,
+						   fade->details->frame_picture,
+						   fade->details->start_picture,
+						   fade->details->end_picture,
+						   alpha / 256.0);
+		gdk_window_invalidate_rect (fade->details->window, NULL, FALSE);
+	} else {
+		blend_frame (fade, alpha);
+		upload_frame (fade);
+		gdk_window_invalidate_region (fade->details->window,
+					      fade->details->dirty, FALSE);
+	}
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_FADE_FRAME, start);
+
+	check_frame_time (fade, frame_clock, now, g_get_monotonic_time () - start);
+}
+
+static void
+nautilus_background_crossfade_dispose (GObject *object)
+{
+	NautilusBackgroundCrossfade *fade;
+
+	fade = NAUTILUS_BACKGROUND_CROSSFADE (object);
+
+	/* Don't leave a half-blended frame behind */
+	if (fade->details->window != NULL) {
+		stop_updating (fade);
+		set_window_background (fade->details->window,
+				       fade->details->end_surface);
+		gdk_window_invalidate_rect (fade->details->window, NULL, FALSE);
+		g_clear_object (&fade->details->window);
+	}
+
+	G_OBJECT_CLASS (nautilus_background_crossfade_parent_class)->dispose (object);
+}
+
+static void
+nautilus_background_crossfade_finalize (GObject *object)
+{
+	NautilusBackgroundCrossfade *fade;
+
+	fade = NAUTILUS_BACKGROUND_CROSSFADE (object);
+
+	g_clear_pointer (&fade->details->start_surface, cairo_surface_destroy);
+	g_clear_pointer (&fade->details->start_image, cairo_surface_destroy);
+	g_clear_pointer (&fade->details->end_image, cairo_surface_destroy);
+	g_clear_pointer (&fade->details->end_surface, cairo_surface_destroy);
+
+	G_OBJECT_CLASS (nautilus_background_crossfade_parent_class)->finalize (object);
+}
+
+static void
+nautilus_background_crossfade_class_init (NautilusBackgroundCrossfadeClass *klass)
+{
+	GObjectClass *object_class;
+
+	object_class = G_OBJECT_CLASS (klass);
+	object_class->dispose = nautilus_background_crossfade_dispose;
+	object_class->finalize = nautilus_background_crossfade_finalize;
+
+	signals[FINISHED] = g_signal_new ("finished",
+					  G_TYPE_FROM_CLASS (klass),
+					  G_SIGNAL_RUN_LAST,
+					  G_STRUCT_OFFSET (NautilusBackgroundCrossfadeClass, finished),
+					  NULL, NULL,
+					  g_cclosure_marshal_VOID__OBJECT,
+					  G_TYPE_NONE, 1, G_TYPE_OBJECT);
+
+	g_type_class_add_private (klass, sizeof (NautilusBackgroundCrossfadeDetails));
+}
+
+static void
+nautilus_background_crossfade_init (NautilusBackgroundCrossfade *fade)
+{
+	fade->details =
+		G_TYPE_INSTANCE_GET_PRIVATE (fade,
+					     NAUTILUS_TYPE_BACKGROUND_CROSSFADE,
+					     NautilusBackgroundCrossfadeDetails);
+}
+
+NautilusBackgroundCrossfade *
+nautilus_background_crossfade_new (int width,
+				   int height)
+{
+	NautilusBackgroundCrossfade *fade;
+
+	fade = g_object_new (NAUTILUS_TYPE_BACKGROUND_CROSSFADE, NULL);
+	fade->details->width = width;
+	fade->details->height = height;
+
+	return fade;
+}
+
+/* Must be called before any surface is set */
+void
+nautilus_background_crossfade_set_use_xrender (NautilusBackgroundCrossfade *fade,
+					       gboolean use_xrender)
+{
+	g_return_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade));
+	g_return_if_fail (fade->details->start_surface == NULL &&
+			  fade->details->start_image == NULL);
+
+	fade->details->use_xrender = use_xrender;
+}
+
+/* Must be called before any surface is set */
+void
+nautilus_background_crossfade_set_low_memory (NautilusBackgroundCrossfade *fade,
+					      gboolean low_memory)
+{
+	g_return_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade));
+	g_return_if_fail (fade->details->start_surface == NULL &&
+			  fade->details->start_image == NULL);
+
+	fade->details->low_memory = low_memory;
+}
+
+gboolean
+nautilus_background_crossfade_set_start_surface (NautilusBackgroundCrossfade *fade,
+						 cairo_surface_t *surface)
+{
+	g_return_val_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade), FALSE);
+
+	if (fade->details->use_xrender || fade->details->low_memory) {
+		g_clear_pointer (&fade->details->start_surface, cairo_surface_destroy);
+		fade->details->start_surface = cairo_surface_reference (surface);
+		return TRUE;
+	}
+
+	g_clear_pointer (&fade->details->start_image, cairo_surface_destroy);
+	fade->details->start_image = copy_to_image (fade, surface);
+
+	return cairo_surface_status (fade->details->start_image) == CAIRO_STATUS_SUCCESS;
+}
+
+gboolean
+nautilus_background_crossfade_set_end_surface (NautilusBackgroundCrossfade *fade,
+					       cairo_surface_t *surface)
+{
+	g_return_val_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade), FALSE);
+
+	if (fade->details->end_picture != None) {
+		nautilus_background_xrender_picture_free (fade->details->end_surface,
+							  fade->details->end_picture);
+		fade->details->end_picture = None;
+	}
+	g_clear_pointer (&fade->details->end_image, cairo_surface_destroy);
+	g_clear_pointer (&fade->details->end_surface, cairo_surface_destroy);
+
+	fade->details->end_surface = cairo_surface_reference (surface);
+
+	if (fade->details->use_xrender) {
+		/* A new end while fading: keep going towards it */
+		if (fade->details->frame_picture != None) {
+			fade->details->end_picture =
+				nautilus_background_xrender_picture_new (surface,
+									 fade->details->width,
+									 fade->details->height);
+		}
+		return TRUE;
+	}
+
+	/* Read back in nautilus_background_crossfade_start() */
+	if (fade->details->low_memory && fade->details->dirty == NULL) {
+		return TRUE;
+	}
+
+	fade->details->end_image = copy_to_image (fade, surface);
+
+	if (cairo_surface_status (fade->details->end_image) != CAIRO_STATUS_SUCCESS) {
+		return FALSE;
+	}
+
+	/* A new end while fading: keep going towards it */
+	if (fade->details->dirty != NULL && fade->details->start_image != NULL) {
+		cairo_region_destroy (fade->details->dirty);
+		fade->details->dirty = compute_dirty_region (fade);
+	}
+
+	return TRUE;
+}
+
+/* Surfaces that are not pixmaps already are uploaded once */
+static void
+ensure_on_server (NautilusBackgroundCrossfade *fade,
+		  GdkWindow *window,
+		  cairo_surface_t **surface)
+{
+	cairo_surface_t *copy;
+	cairo_t *cr;
+
+	if (cairo_surface_get_type (*surface) == CAIRO_SURFACE_TYPE_XLIB) {
+		return;
+	}
+
+	copy = gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+						  fade->details->width,
+						  fade->details->height);
+	cr = cairo_create (copy);
+	cairo_set_source_surface (cr, *surface, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	cairo_surface_destroy (*surface);
+	*surface = copy;
+}
+
+static gboolean
+start_xrender (NautilusBackgroundCrossfade *fade,
+	       GdkWindow *window)
+{
+	if (!nautilus_background_xrender_is_supported (gdk_window_get_display (window))) {
+		return FALSE;
+	}
+
+	ensure_on_server (fade, window, &fade->details->start_surface);
+	ensure_on_server (fade, window, &fade->details->end_surface);
+
+	fade->details->frame_surface =
+		gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+						   fade->details->width,
+						   fade->details->height);
+
+	fade->details->frame_picture =
+		nautilus_background_xrender_picture_new (fade->details->frame_surface,
+							 fade->details->width,
+							 fade->details->height);
+	fade->details->start_picture =
+		nautilus_background_xrender_picture_new (fade->details->start_surface,
+							 fade->details->width,
+							 fade->details->height);
+	fade->details->end_picture =
+		nautilus_background_xrender_picture_new (fade->details->end_surface,
+							 fade->details->width,
+							 fade->details->height);
+
+	if (fade->details->frame_picture == None ||
+	    fade->details->start_picture == None ||
+	    fade->details->end_picture == None) {
+		stop_updating (fade);
+		return FALSE;
+	}
+
+	nautilus_background_xrender_blend (fade->details->frame_surface,
+					   fade->details->frame_picture,
+					   fade->details->start_picture,
+					   fade->details->end_picture,
+					   0.0);
+
+	return TRUE;
+}
+
+static void
+start_client (NautilusBackgroundCrossfade *fade,
+	      GdkWindow *window)
+{
+	cairo_t *cr;
+
+	fade->details->dirty = compute_dirty_region (fade);
+
+	fade->details->frame_image = copy_to_image (fade, fade->details->start_image);
+	fade->details->frame_surface =
+		gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+						   fade->details->width,
+						   fade->details->height);
+
+	cr = cairo_create (fade->details->frame_surface);
+	cairo_set_source_surface (cr, fade->details->start_image, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+}
+
+void
+nautilus_background_crossfade_start (NautilusBackgroundCrossfade *fade,
+				     GdkWindow *window)
+{
+	g_return_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade));
+	g_return_if_fail (fade->details->end_surface != NULL);
+	g_return_if_fail (!nautilus_background_crossfade_is_started (fade));
+
+	if (fade->details->use_xrender) {
+		g_return_if_fail (fade->details->start_surface != NULL);
+
+		if (!start_xrender (fade, window)) {
+			/* No RENDER on this server, blend on the client */
+			fade->details->start_image = copy_to_image (fade, fade->details->start_surface);
+			fade->details->end_image = copy_to_image (fade, fade->details->end_surface);
+			start_client (fade, window);
+		}
+	} else {
+		if (fade->details->low_memory) {
+			g_return_if_fail (fade->details->start_surface != NULL);
+
+			fade->details->start_image = copy_to_image (fade, fade->details->start_surface);
+			fade->details->end_image = copy_to_image (fade, fade->details->end_surface);
+			g_clear_pointer (&fade->details->start_surface, cairo_surface_destroy);
+		}
+
+		g_return_if_fail (fade->details->start_image != NULL);
+		g_return_if_fail (fade->details->end_image != NULL);
+
+		start_client (fade, window);
+	}
+
+	fade->details->window = g_object_ref (window);
+	set_window_background (window, fade->details->frame_surface);
+
+	fade->details->start_time = 0;
+	fade->details->last_alpha = 0;
+	fade->details->level = host_level;
+	fade->details->last_frame_time = 0;
+	fade->details->missed_frames = 0;
+	fade->details->missed_any = FALSE;
+	fade->details->frame_clock = g_object_ref (gdk_window_get_frame_clock (window));
+	fade->details->update_id =
+		g_signal_connect (fade->details->frame_clock, "update",
+				  G_CALLBACK (on_frame_clock_update), fade);
+	gdk_frame_clock_begin_updating (fade->details->frame_clock);
+}
+
+gboolean
+nautilus_background_crossfade_is_started (NautilusBackgroundCrossfade *fade)
+{
+	g_return_val_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade), FALSE);
+
+	return fade->details->window != NULL;
+}
+
+/* Jumps to the end, "finished" is emitted as for a complete fade */
+void
+nautilus_background_crossfade_stop (NautilusBackgroundCrossfade *fade)
+{
+	g_return_if_fail (NAUTILUS_IS_BACKGROUND_CROSSFADE (fade));
+
+	if (nautilus_background_crossfade_is_started (fade)) {
+		finish (fade);
+	}
+}
+
+guint
+nautilus_background_crossfade_get_n_frames (void)
+{
+	return FADE_DURATION / DEFAULT_FRAME_BUDGET;
+}
@@ -0,0 +1,84 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-crossfade.h: Crossfades the desktop window between backgrounds.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_CROSSFADE_H__
+#define __NAUTILUS_BACKGROUND_CROSSFADE_H__
+
+#include <gtk/gtk.h>
+
+typedef struct NautilusBackgroundCrossfade NautilusBackgroundCrossfade;
+typedef struct NautilusBackgroundCrossfadeClass NautilusBackgroundCrossfadeClass;
+
+#define NAUTILUS_TYPE_BACKGROUND_CROSSFADE nautilus_background_crossfade_get_type()
+#define NAUTILUS_BACKGROUND_CROSSFADE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_BACKGROUND_CROSSFADE, NautilusBackgroundCrossfade))
+#define NAUTILUS_BACKGROUND_CROSSFADE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), NAUTILUS_TYPE_BACKGROUND_CROSSFADE, NautilusBackgroundCrossfadeClass))
+#define NAUTILUS_IS_BACKGROUND_CROSSFADE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), NAUTILUS_TYPE_BACKGROUND_CROSSFADE))
+#define NAUTILUS_IS_BACKGROUND_CROSSFADE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), NAUTILUS_TYPE_BACKGROUND_CROSSFADE))
+#define NAUTILUS_BACKGROUND_CROSSFADE_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_BACKGROUND_CROSSFADE, NautilusBackgroundCrossfadeClass))
+
+typedef struct NautilusBackgroundCrossfadeDetails NautilusBackgroundCrossfadeDetails;
+
+struct NautilusBackgroundCrossfade {
+	GObject parent;
+	NautilusBackgroundCrossfadeDetails *details;
+};
+
+struct NautilusBackgroundCrossfadeClass {
+	GObjectClass parent_class;
+
+	void (* finished) (NautilusBackgroundCrossfade *fade,
+			   GdkWindow                   *window);
+};
+
+/* Works like GnomeBGCrossfade, but frames are paced by the window's
+ * GdkFrameClock and only the parts of the screen that differ between
+ * the two backgrounds are blended. With XRender, every frame is
+ * composited on the X server from the two background pixmaps.
+ */
+GType                        nautilus_background_crossfade_get_type          (void);
+NautilusBackgroundCrossfade *nautilus_background_crossfade_new               (int                          width,
+									      int                          height);
+void                         nautilus_background_crossfade_set_use_xrender   (NautilusBackgroundCrossfade *fade,
+									      gboolean                     use_xrender);
+void                         nautilus_background_crossfade_set_low_memory    (NautilusBackgroundCrossfade *fade,
+									      gboolean                     low_memory);
+gboolean                     nautilus_background_crossfade_set_start_surface (NautilusBackgroundCrossfade *fade,
+									      cairo_surface_t             *surface);
+gboolean                     nautilus_background_crossfade_set_end_surface   (NautilusBackgroundCrossfade *fade,
+									      cairo_surface_t             *surface);
+void                         nautilus_background_crossfade_start             (NautilusBackgroundCrossfade *fade,
+									      GdkWindow                   *window);
+gboolean                     nautilus_background_crossfade_is_started        (NautilusBackgroundCrossfade *fade);
+void                         nautilus_background_crossfade_stop              (NautilusBackgroundCrossfade *fade);
+
+/* Frames a fade draws on a 60 Hz screen, when nothing holds it back */
+guint                        nautilus_background_crossfade_get_n_frames      (void);
+
+#endif /* __NAUTILUS_BACKGROUND_CROSSFADE_H__ */
@@ -0,0 +1,134 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-decode.c: Decodes pictures at the size they are shown at.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#include "background-decode.h"
+
+#include <math.h>
+
+/* Read size per loader write; the whole file is never in memory */
+#define DECODE_CHUNK_SIZE (64 * 1024)
+
+typedef struct {
+	GDesktopBackgroundStyle placement;
+	int width;
+	int height;
+} DecodeTarget;
+
+/* How much the picture gets scaled when it is placed. Only known for
+ * one orientation at this point, so the larger of the two is used.
+ */
+static double
+get_factor (const DecodeTarget *target,
+	    int width,
+	    int height)
+{
+	double fx, fy, rx, ry;
+
+	fx = (double) target->width / width;
+	fy = (double) target->height / height;
+	rx = (double) target->width / height;
+	ry = (double) target->height / width;
+
+	switch (target->placement) {
+	case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+	case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+	case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+		return MAX (MAX (fx, fy), MAX (rx, ry));
+	case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+		return MAX (MIN (fx, fy), MIN (rx, ry));
+	default:
+		/* Shown pixel for pixel */
+		return 1.0;
+	}
+}
+
+static void
+on_size_prepared (GdkPixbufLoader *loader,
+		  int width,
+		  int height,
+		  DecodeTarget *target)
+{
+	double factor;
+
+	factor = get_factor (target, width, height);
+	if (factor >= 1.0) {
+		return;
+	}
+
+	gdk_pixbuf_loader_set_size (loader,
+				    MAX (1, (int) ceil (width * factor)),
+				    MAX (1, (int) ceil (height * factor)));
+}
+
+GdkPixbuf *
+nautilus_background_decode (const char *filename,
+			    GDesktopBackgroundStyle placement,
+			    int width,
+			    int height)
+{
+	GdkPixbufLoader *loader;
+	GFile *file;
+	GFileInputStream *stream;
+	GdkPixbuf *pixbuf = NULL;
+	DecodeTarget target = { placement, width, height };
+	guchar *buffer;
+	gssize n_read;
+	gboolean ok;
+
+	file = g_file_new_for_path (filename);
+	stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+	if (stream == NULL) {
+		return NULL;
+	}
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (on_size_prepared), &target);
+
+	buffer = g_malloc (DECODE_CHUNK_SIZE);
+	ok = TRUE;
+	while (ok) {
+		n_read = g_input_stream_read (G_INPUT_STREAM (stream),
+					      buffer, DECODE_CHUNK_SIZE, NULL, NULL);
+		if (n_read <= 0) {
+			ok = (n_read == 0);
+			break;
+		}
+		ok = gdk_pixbuf_loader_write (loader, buffer, n_read, NULL);
+	}
+	g_free (buffer);
+	g_object_unref (stream);
+
+	ok = gdk_pixbuf_loader_close (loader, NULL) && ok;
+
+	if (ok && gdk_pixbuf_loader_get_pixbuf (loader) != NULL) {
+		pixbuf = gdk_pixbuf_apply_embedded_orientation (gdk_pixbuf_loader_get_pixbuf (loader));
+	}
+	g_object_unref (loader);
+
+	return pixbuf;
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-decode.h: Decodes pictures at the size they are shown at.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#ifndef __NAUTILUS_BACKGROUND_DECODE_H__
+#define __NAUTILUS_BACKGROUND_DECODE_H__
+
+#include <gtk/gtk.h>
+#include <gdesktop-enums.h>
+
+/* Decodes @filename no larger than it needs to be to cover a
+ * @width x @height area with the given @placement, letting the
+ * decoder scale down where it can (libjpeg decodes at 1/2, 1/4 or
+ * 1/8 size directly from the DCT). The picture is never enlarged,
+ * and comes back with its EXIF orientation applied. Safe to call
+ * from the render thread.
+ */
+GdkPixbuf *nautilus_background_decode (const char              *filename,
+				       GDesktopBackgroundStyle  placement,
+				       int                      width,
+				       int                      height);
+
+#endif /* __NAUTILUS_BACKGROUND_DECODE_H__ */
@@ -0,0 +1,161 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-frames.c: Memory-bounded cache of rendered slideshow frames.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-frames.h"
+
+typedef struct {
+	char *key;
+	cairo_surface_t *surface;
+	gsize size;
+} Frame;
+
+static GMutex frames_lock;
+static GHashTable *frames = NULL; /* key -> GList link in lru */
+static GQueue lru = G_QUEUE_INIT; /* most recently used first */
+static gsize frames_size = 0;
+static gsize frames_budget = NAUTILUS_BACKGROUND_FRAMES_DEFAULT_BUDGET;
+
+static gsize
+frame_size (cairo_surface_t *surface)
+{
+	return (gsize) cairo_image_surface_get_stride (surface) *
+		cairo_image_surface_get_height (surface);
+}
+
+static void
+frame_free (Frame *frame)
+{
+	g_free (frame->key);
+	cairo_surface_destroy (frame->surface);
+	g_slice_free (Frame, frame);
+}
+
+static void
+remove_link (GList *link)
+{
+	Frame *frame = link->data;
+
+	g_hash_table_remove (frames, frame->key);
+	g_queue_delete_link (&lru, link);
+	frames_size -= frame->size;
+	frame_free (frame);
+}
+
+/* Called with the lock held */
+static void
+evict (void)
+{
+	while (frames_size > frames_budget && lru.tail != NULL) {
+		remove_link (lru.tail);
+	}
+}
+
+cairo_surface_t *
+nautilus_background_frames_lookup (const char *key)
+{
+	GList *link;
+	cairo_surface_t *surface = NULL;
+
+	g_mutex_lock (&frames_lock);
+
+	if (frames != NULL) {
+		link = g_hash_table_lookup (frames, key);
+		if (link != NULL) {
+			g_queue_unlink (&lru, link);
+			g_queue_push_head_link (&lru, link);
+			surface = cairo_surface_reference (((Frame *) link->data)->surface);
+		}
+	}
+
+	g_mutex_unlock (&frames_lock);
+
+	return surface;
+}
+
+void
+nautilus_background_frames_insert (const char *key,
+				   cairo_surface_t *surface)
+{
+	GList *link;
+	Frame *frame;
+
+	g_return_if_fail (cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_IMAGE);
+
+	g_mutex_lock (&frames_lock);
+
+	if (frames == NULL) {
+		frames = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	link = g_hash_table_lookup (frames, key);
+	if (link != NULL) {
+		remove_link (link);
+	}
+
+	frame = g_slice_new (Frame);
+	frame->key = g_strdup (key);
+	frame->surface = cairo_surface_reference (surface);
+	frame->size = frame_size (surface);
+
+	g_queue_push_head (&lru, frame);
+	g_hash_table_insert (frames, frame->key, lru.head);
+	frames_size += frame->size;
+
+	evict ();
+
+	g_mutex_unlock (&frames_lock);
+}
+
+void
+nautilus_background_frames_set_budget (gsize bytes)
+{
+	g_mutex_lock (&frames_lock);
+	frames_budget = bytes;
+	evict ();
+	g_mutex_unlock (&frames_lock);
+}
+
+void
+nautilus_background_frames_clear (void)
+{
+	g_mutex_lock (&frames_lock);
+	while (lru.tail != NULL) {
+		remove_link (lru.tail);
+	}
+	g_mutex_unlock (&frames_lock);
+}
+
+/* Bytes of pixel data currently held */
+gsize
+nautilus_background_frames_get_size (void)
+{
+	gsize size;
+
+	g_mutex_lock (&frames_lock);
+	size = frames_size;
+	g_mutex_unlock (&frames_lock);
+
+	return size;
+}
@@ -0,0 +1,44 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-frames.h: Memory-bounded cache of rendered slideshow frames.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_FRAMES_H__
+#define __NAUTILUS_BACKGROUND_FRAMES_H__
+
+#include <gtk/gtk.h>
+
+/* Enough for the current and the next frame on a 4K monitor */
+#define NAUTILUS_BACKGROUND_FRAMES_DEFAULT_BUDGET (96 * 1024 * 1024)
+
+/* Least recently used frames are evicted once the cache holds more
+ * than its budget of pixel data. All functions are thread-safe.
+ */
+cairo_surface_t *nautilus_background_frames_lookup     (const char      *key);
+void             nautilus_background_frames_insert     (const char      *key,
+							cairo_surface_t *frame);
+void             nautilus_background_frames_set_budget (gsize            bytes);
+void             nautilus_background_frames_clear      (void);
+gsize            nautilus_background_frames_get_size   (void);
+
+#endif /* __NAUTILUS_BACKGROUND_FRAMES_H__ */
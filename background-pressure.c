@@ -0,0 +1,246 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-pressure.c: Tells when the system runs short of memory.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-pressure.h"
+#include "background-stats.h"
+
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#define HAVE_MALLOC_TRIM 1
+#include <malloc.h>
+#endif
+
+#define PSI_MEMORY_PATH "/proc/pressure/memory"
+
+/* Some task stalled on memory for 150 ms within 2 s. Unprivileged
+ * triggers need a window that is a multiple of 2 s.
+ */
+#define PSI_TRIGGER "some 150000 2000000"
+
+/* Pressure reported again within this long goes one level up */
+#define ESCALATE_INTERVAL (10 * G_TIME_SPAN_SECOND)
+
+enum {
+	MEMORY_PRESSURE,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+struct NautilusBackgroundPressureDetails {
+#if GLIB_CHECK_VERSION (2, 64, 0)
+	GMemoryMonitor *monitor;
+#endif
+	int psi_fd;
+	guint psi_id;
+
+	NautilusBackgroundPressureLevel last_level;
+	gint64 last_time;
+};
+
+G_DEFINE_TYPE (NautilusBackgroundPressure, nautilus_background_pressure, G_TYPE_OBJECT);
+
+static void
+emit_pressure (NautilusBackgroundPressure *pressure,
+	       NautilusBackgroundPressureLevel level,
+	       const char *source)
+{
+	gint64 now;
+
+	/* Whatever was given back last time wasn't enough */
+	now = g_get_monotonic_time ();
+	if (pressure->details->last_time != 0 &&
+	    now - pressure->details->last_time < ESCALATE_INTERVAL) {
+		level = MAX (level, MIN (pressure->details->last_level + 1,
+					 NAUTILUS_BACKGROUND_PRESSURE_CRITICAL));
+	}
+	pressure->details->last_level = level;
+	pressure->details->last_time = now;
+
+	g_debug ("Memory pressure from %s, releasing up to level %d", source, level);
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_MEMORY_RELEASES, 1);
+
+	g_signal_emit (pressure, signals[MEMORY_PRESSURE], 0, level);
+
+#ifdef HAVE_MALLOC_TRIM
+	/* Freed images are large enough to be mmapped and go back on
+	 * their own, but tiles and pixbufs can be left on the heap.
+	 */
+	malloc_trim (0);
+#endif
+}
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+static void
+on_low_memory_warning (GMemoryMonitor *monitor,
+		       GMemoryMonitorWarningLevel warning_level,
+		       NautilusBackgroundPressure *pressure)
+{
+	NautilusBackgroundPressureLevel level;
+
+	if (warning_level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL) {
+		level = NAUTILUS_BACKGROUND_PRESSURE_CRITICAL;
+	} else if (warning_level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM) {
+		level = NAUTILUS_BACKGROUND_PRESSURE_MEDIUM;
+	} else {
+		level = NAUTILUS_BACKGROUND_PRESSURE_LOW;
+	}
+
+	emit_pressure (pressure, level, "GMemoryMonitor");
+}
+#endif
+
+static gboolean
+on_psi_event (gint fd,
+	      GIOCondition condition,
+	      gpointer user_data)
+{
+	NautilusBackgroundPressure *pressure = user_data;
+
+	/* The kernel took the trigger away, e.g. the cgroup is gone */
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		pressure->details->psi_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	emit_pressure (pressure, NAUTILUS_BACKGROUND_PRESSURE_LOW, "PSI");
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Not all kernels have PSI, and before Linux 6.5 triggers need
+ * CAP_SYS_RESOURCE. GMemoryMonitor is all there is then.
+ */
+static void
+open_psi_trigger (NautilusBackgroundPressure *pressure)
+{
+	int fd;
+
+	fd = open (PSI_MEMORY_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		g_debug ("No memory pressure trigger: %s", g_strerror (errno));
+		return;
+	}
+
+	if (write (fd, PSI_TRIGGER, strlen (PSI_TRIGGER) + 1) < 0) {
+		g_debug ("No memory pressure trigger: %s", g_strerror (errno));
+		close (fd);
+		return;
+	}
+
+	pressure->details->psi_fd = fd;
+	pressure->details->psi_id = g_unix_fd_add (fd, G_IO_PRI | G_IO_ERR,
+						   on_psi_event, pressure);
+}
+
+static void
+nautilus_background_pressure_constructed (GObject *object)
+{
+	NautilusBackgroundPressure *pressure;
+
+	pressure = NAUTILUS_BACKGROUND_PRESSURE (object);
+
+	G_OBJECT_CLASS (nautilus_background_pressure_parent_class)->constructed (object);
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+	pressure->details->monitor = g_memory_monitor_dup_default ();
+	g_signal_connect (pressure->details->monitor, "low-memory-warning",
+			  G_CALLBACK (on_low_memory_warning), pressure);
+#endif
+
+	open_psi_trigger (pressure);
+}
+
+static void
+nautilus_background_pressure_finalize (GObject *object)
+{
+	NautilusBackgroundPressure *pressure;
+
+	pressure = NAUTILUS_BACKGROUND_PRESSURE (object);
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+	if (pressure->details->monitor != NULL) {
+		g_signal_handlers_disconnect_by_func (pressure->details->monitor,
+						      on_low_memory_warning, pressure);
+		g_clear_object (&pressure->details->monitor);
+	}
+#endif
+
+	if (pressure->details->psi_id != 0) {
+		g_source_remove (pressure->details->psi_id);
+	}
+	if (pressure->details->psi_fd >= 0) {
+		close (pressure->details->psi_fd);
+	}
+
+	G_OBJECT_CLASS (nautilus_background_pressure_parent_class)->finalize (object);
+}
+
+static void
+nautilus_background_pressure_class_init (NautilusBackgroundPressureClass *klass)
+{
+	GObjectClass *object_class;
+
+	object_class = G_OBJECT_CLASS (klass);
+	object_class->constructed = nautilus_background_pressure_constructed;
+	object_class->finalize = nautilus_background_pressure_finalize;
+
+	signals[MEMORY_PRESSURE] = g_signal_new ("memory-pressure",
+						 G_TYPE_FROM_CLASS (klass),
+						 G_SIGNAL_RUN_LAST,
+						 G_STRUCT_OFFSET (NautilusBackgroundPressureClass, memory_pressure),
+						 NULL, NULL,
+						 g_cclosure_marshal_VOID__INT,
+						 G_TYPE_NONE, 1, G_TYPE_INT);
+
+	g_type_class_add_private (klass, sizeof (NautilusBackgroundPressureDetails));
+}
+
+static void
+nautilus_background_pressure_init (NautilusBackgroundPressure *pressure)
+{
+	pressure->details =
+		G_TYPE_INSTANCE_GET_PRIVATE (pressure,
+					     NAUTILUS_TYPE_BACKGROUND_PRESSURE,
+					     NautilusBackgroundPressureDetails);
+	pressure->details->psi_fd = -1;
+}
+
+NautilusBackgroundPressure *
+nautilus_background_pressure_get_default (void)
+{
+	static NautilusBackgroundPressure *pressure = NULL;
+
+	if (pressure == NULL) {
+		pressure = g_object_new (NAUTILUS_TYPE_BACKGROUND_PRESSURE, NULL);
+	}
+
+	return pressure;
+}
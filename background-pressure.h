@@ -0,0 +1,79 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-pressure.h: Tells when the system runs short of memory.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_PRESSURE_H__
+#define __NAUTILUS_BACKGROUND_PRESSURE_H__
+
+#include <gtk/gtk.h>
+
+typedef struct NautilusBackgroundPressure NautilusBackgroundPressure;
+typedef struct NautilusBackgroundPressureClass NautilusBackgroundPressureClass;
+
+#define NAUTILUS_TYPE_BACKGROUND_PRESSURE nautilus_background_pressure_get_type()
+#define NAUTILUS_BACKGROUND_PRESSURE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), NAUTILUS_TYPE_BACKGROUND_PRESSURE, NautilusBackgroundPressure))
+#define NAUTILUS_BACKGROUND_PRESSURE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), NAUTILUS_TYPE_BACKGROUND_PRESSURE, NautilusBackgroundPressureClass))
+#define NAUTILUS_IS_BACKGROUND_PRESSURE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), NAUTILUS_TYPE_BACKGROUND_PRESSURE))
+#define NAUTILUS_IS_BACKGROUND_PRESSURE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), NAUTILUS_TYPE_BACKGROUND_PRESSURE))
+#define NAUTILUS_BACKGROUND_PRESSURE_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), NAUTILUS_TYPE_BACKGROUND_PRESSURE, NautilusBackgroundPressureClass))
+
+/* How much to give back: each level includes the ones before it */
+typedef enum {
+	/* Whatever the caches can rebuild from disk */
+	NAUTILUS_BACKGROUND_PRESSURE_LOW = 1,
+	/* Also crossfades, previews and animations, which only look nice */
+	NAUTILUS_BACKGROUND_PRESSURE_MEDIUM,
+	/* Also renders still running */
+	NAUTILUS_BACKGROUND_PRESSURE_CRITICAL,
+} NautilusBackgroundPressureLevel;
+
+typedef struct NautilusBackgroundPressureDetails NautilusBackgroundPressureDetails;
+
+struct NautilusBackgroundPressure {
+	GObject parent;
+	NautilusBackgroundPressureDetails *details;
+};
+
+struct NautilusBackgroundPressureClass {
+	GObjectClass parent_class;
+
+	void (* memory_pressure) (NautilusBackgroundPressure      *pressure,
+				  NautilusBackgroundPressureLevel  level);
+};
+
+/* Listens to GMemoryMonitor and to a PSI trigger on
+ * /proc/pressure/memory, whichever are there. "memory-pressure" is
+ * emitted with a higher level each time pressure persists, and
+ * freed heap memory is handed back to the kernel afterwards.
+ * Memory is shared by the whole process, so there is one of these.
+ */
+GType                       nautilus_background_pressure_get_type    (void);
+NautilusBackgroundPressure *nautilus_background_pressure_get_default (void);
+
+#endif /* __NAUTILUS_BACKGROUND_PRESSURE_H__ */
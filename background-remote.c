@@ -0,0 +1,82 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-remote.c: Tells displays that are sent over the network.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-remote.h"
+
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <string.h>
+
+/* "host:0" connects over TCP, ":0" and "unix:0" locally. Forwarded
+ * X shows up as "localhost:10" and the like.
+ */
+static gboolean
+is_tcp_display (const char *name)
+{
+	const char *colon;
+
+	if (name == NULL || name[0] == '/') {
+		return FALSE;
+	}
+
+	colon = strrchr (name, ':');
+	if (colon == NULL || colon == name) {
+		return FALSE;
+	}
+
+	return strncmp (name, "unix:", colon - name + 1) != 0;
+}
+
+const char *
+nautilus_background_remote_detect (GdkDisplay *display)
+{
+	Display *xdisplay;
+	char *vendor;
+	gboolean is_vnc;
+	int opcode, event, error;
+
+	if (!GDK_IS_X11_DISPLAY (display)) {
+		return NULL;
+	}
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+	/* Xvnc and x0vncserver's module register this one */
+	if (XQueryExtension (xdisplay, "VNC-EXTENSION", &opcode, &event, &error)) {
+		return "VNC-EXTENSION";
+	}
+
+	vendor = g_ascii_strup (ServerVendor (xdisplay), -1);
+	is_vnc = strstr (vendor, "VNC") != NULL;
+	g_free (vendor);
+	if (is_vnc) {
+		return "VNC server";
+	}
+
+	if (is_tcp_display (gdk_display_get_name (display))) {
+		return g_getenv ("SSH_CONNECTION") != NULL ? "forwarded over SSH" : "X over TCP";
+	}
+
+	return NULL;
+}
@@ -0,0 +1,38 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-remote.h: Tells displays that are sent over the network.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_REMOTE_H__
+#define __NAUTILUS_BACKGROUND_REMOTE_H__
+
+#include <gtk/gtk.h>
+
+/* On Xvnc or forwarded X, every pixel that changes on the screen is
+ * sent over the network, so a crossfade is dozens of full-screen
+ * updates. Returns why @display looks like one of those, or NULL if
+ * it looks local.
+ */
+const char *nautilus_background_remote_detect (GdkDisplay *display);
+
+#endif /* __NAUTILUS_BACKGROUND_REMOTE_H__ */
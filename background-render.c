@@ -0,0 +1,1444 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-render.c: Renders desktop backgrounds off the main thread.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-render.h"
+
+#include "background-cache.h"
+#include "background-decode.h"
+#include "background-frames.h"
+#include "background-scale.h"
+#include "background-stats.h"
+#include "background-xshm.h"
+
+#include <cairo-xlib.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+
+#define GNOME_DESKTOP_USE_UNSTABLE_API
+#include <libgnome-desktop/gnome-bg.h>
+#include <libgnome-desktop/gnome-bg-slide-show.h>
+
+#include <glib/gstdio.h>
+#include <math.h>
+
+/* Everything in org.gnome.desktop.background that changes the picture */
+static const char * const render_keys[] = {
+	"picture-uri",
+	"picture-options",
+	"picture-opacity",
+	"primary-color",
+	"secondary-color",
+	"color-shading-type",
+	NULL
+};
+
+struct NautilusBackgroundRenderJob {
+	/* Private to the job, never seen by the main loop's GnomeBG */
+	GnomeBG *bg;
+	/* Same colours, no picture; drawn under pictures we place */
+	GnomeBG *color_bg;
+	GDesktopBackgroundStyle placement;
+	char *filename;
+
+	/* Loaded on the render thread when filename is a slideshow */
+	GnomeBGSlideShow *slide_show;
+
+	/* Only passed through to gnome_bg_draw(), which does not
+	 * look at it when not drawing a root window.
+	 */
+	GdkScreen *screen;
+
+	int width;
+	int height;
+	int n_monitors;
+	GdkRectangle *monitors;
+	int *scales;
+
+	/* Printed values of render_keys, for the cache key */
+	char *settings_key;
+
+	/* Surface to compose into, e.g. shared with the X server */
+	cairo_surface_t *target;
+
+	/* A tiled picture on a plain colour: one tile is all there is
+	 * to render, the X server repeats it.
+	 */
+	gboolean tile_once;
+
+	/* A quick, small stand-in for the real render */
+	gboolean preview;
+
+	/* Few colours, for displays sent over the network */
+	gboolean posterize;
+};
+
+/* Read on the render thread */
+static volatile gint low_memory = FALSE;
+
+NautilusBackgroundRenderJob *
+nautilus_background_render_job_new (GSettings *settings,
+				    GdkScreen *screen)
+{
+	NautilusBackgroundRenderJob *job;
+	GString *settings_key;
+	GVariant *value;
+	GDesktopBackgroundShading shading;
+	GdkColor primary, secondary;
+	char *printed;
+	int i;
+
+	job = g_slice_new0 (NautilusBackgroundRenderJob);
+
+	job->bg = gnome_bg_new ();
+	gnome_bg_load_from_preferences (job->bg, settings);
+	job->placement = gnome_bg_get_placement (job->bg);
+	job->filename = g_strdup (gnome_bg_get_filename (job->bg));
+
+	job->screen = g_object_ref (screen);
+	job->width = gdk_screen_get_width (screen);
+	job->height = gdk_screen_get_height (screen);
+
+	job->n_monitors = gdk_screen_get_n_monitors (screen);
+	job->monitors = g_new0 (GdkRectangle, MAX (job->n_monitors, 1));
+	job->scales = g_new0 (int, MAX (job->n_monitors, 1));
+	for (i = 0; i < job->n_monitors; i++) {
+		gdk_screen_get_monitor_geometry (screen, i, &job->monitors[i]);
+		job->scales[i] = gdk_screen_get_monitor_scale_factor (screen, i);
+	}
+
+	settings_key = g_string_new (NULL);
+	for (i = 0; render_keys[i] != NULL; i++) {
+		value = g_settings_get_value (settings, render_keys[i]);
+		printed = g_variant_print (value, FALSE);
+		g_string_append_printf (settings_key, "%s=%s\n", render_keys[i], printed);
+		g_free (printed);
+		g_variant_unref (value);
+	}
+	job->settings_key = g_string_free (settings_key, FALSE);
+
+	/* Slideshows are XML files; gnome_bg_changes_with_time()
+	 * would tell for sure, but it reads the whole file.
+	 */
+	gnome_bg_get_color (job->bg, &shading, &primary, &secondary);
+	job->color_bg = gnome_bg_new ();
+	gnome_bg_set_color (job->color_bg, shading, &primary, &secondary);
+
+	job->tile_once = job->placement == G_DESKTOP_BACKGROUND_STYLE_WALLPAPER &&
+			 shading == G_DESKTOP_BACKGROUND_SHADING_SOLID &&
+			 job->filename != NULL &&
+			 !g_str_has_suffix (job->filename, ".xml");
+
+	return job;
+}
+
+void
+nautilus_background_render_job_free (NautilusBackgroundRenderJob *job)
+{
+	g_clear_object (&job->bg);
+	g_clear_object (&job->color_bg);
+	g_clear_object (&job->slide_show);
+	g_clear_object (&job->screen);
+	g_free (job->filename);
+	g_free (job->monitors);
+	g_free (job->scales);
+	g_free (job->settings_key);
+	g_clear_pointer (&job->target, cairo_surface_destroy);
+
+	g_slice_free (NautilusBackgroundRenderJob, job);
+}
+
+void
+nautilus_background_render_job_set_target (NautilusBackgroundRenderJob *job,
+					    cairo_surface_t *target)
+{
+	g_return_if_fail (cairo_image_surface_get_width (target) == job->width);
+	g_return_if_fail (cairo_image_surface_get_height (target) == job->height);
+
+	g_clear_pointer (&job->target, cairo_surface_destroy);
+	job->target = cairo_surface_reference (target);
+}
+
+/* Only placements we scale ourselves decode at reduced size, which
+ * is what makes a preview quick. Anything else would cost as much
+ * as the real render.
+ */
+gboolean
+nautilus_background_render_job_set_preview (NautilusBackgroundRenderJob *job,
+					    int divisor)
+{
+	int i;
+
+	g_return_val_if_fail (divisor > 0, FALSE);
+	g_return_val_if_fail (job->target == NULL, FALSE);
+
+	switch (job->placement) {
+	case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+	case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+	case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+	case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (job->filename == NULL || g_str_has_suffix (job->filename, ".xml")) {
+		return FALSE;
+	}
+
+	job->preview = TRUE;
+	job->width = MAX (1, job->width / divisor);
+	job->height = MAX (1, job->height / divisor);
+	for (i = 0; i < job->n_monitors; i++) {
+		job->monitors[i].x /= divisor;
+		job->monitors[i].y /= divisor;
+		job->monitors[i].width = MAX (1, job->monitors[i].width / divisor);
+		job->monitors[i].height = MAX (1, job->monitors[i].height / divisor);
+	}
+
+	return TRUE;
+}
+
+/* Tile-once jobs render a surface the size of the picture, not of
+ * the screen, so they don't want a screen-sized target.
+ */
+gboolean
+nautilus_background_render_job_is_tiled (NautilusBackgroundRenderJob *job)
+{
+	return job->tile_once;
+}
+
+void
+nautilus_background_render_job_set_posterize (NautilusBackgroundRenderJob *job,
+					      gboolean posterize)
+{
+	job->posterize = posterize;
+}
+
+void
+nautilus_background_render_job_get_size (NautilusBackgroundRenderJob *job,
+					 int *width,
+					 int *height)
+{
+	*width = job->width;
+	*height = job->height;
+}
+
+/* Identifies the source of the picture: the settings and the file
+ * they point to as it is on disk right now. Returns NULL for
+ * backgrounds that change with time, they can't be cached.
+ */
+static char *
+get_source_key (NautilusBackgroundRenderJob *job)
+{
+	const char *filename;
+	GStatBuf buf;
+	GString *key;
+
+	if (gnome_bg_changes_with_time (job->bg)) {
+		return NULL;
+	}
+
+	key = g_string_new (job->settings_key);
+
+	filename = gnome_bg_get_filename (job->bg);
+	if (filename != NULL) {
+		if (g_stat (filename, &buf) != 0) {
+			g_string_free (key, TRUE);
+			return NULL;
+		}
+		g_string_append_printf (key, "file=%s %" G_GINT64_FORMAT " %" G_GUINT64_FORMAT "\n",
+					filename,
+					(gint64) buf.st_mtime,
+					(guint64) buf.st_ino);
+	}
+
+	return g_string_free (key, FALSE);
+}
+
+/* The source key plus the screen layout identifies the finished picture */
+static char *
+get_cache_key (NautilusBackgroundRenderJob *job,
+	       const char *source_key)
+{
+	GString *key;
+	int i;
+
+	key = g_string_new (source_key);
+
+	g_string_append_printf (key, "screen=%dx%d\n", job->width, job->height);
+	for (i = 0; i < job->n_monitors; i++) {
+		g_string_append_printf (key, "monitor=%d,%d %dx%d@%d\n",
+					job->monitors[i].x, job->monitors[i].y,
+					job->monitors[i].width, job->monitors[i].height,
+					job->scales[i]);
+	}
+	if (job->posterize) {
+		g_string_append (key, "posterize\n");
+	}
+
+	return g_string_free (key, FALSE);
+}
+
+char *
+nautilus_background_render_job_get_key (NautilusBackgroundRenderJob *job)
+{
+	char *source_key, *cache_key, *key;
+
+	/* Slideshows would have to be parsed here, on the main thread */
+	if (job->preview ||
+	    (job->filename != NULL && g_str_has_suffix (job->filename, ".xml"))) {
+		return NULL;
+	}
+
+	source_key = get_source_key (job);
+	if (source_key == NULL) {
+		return NULL;
+	}
+
+	cache_key = get_cache_key (job, source_key);
+	key = g_compute_checksum_for_string (G_CHECKSUM_SHA256, cache_key, -1);
+
+	g_free (cache_key);
+	g_free (source_key);
+
+	return key;
+}
+
+static cairo_surface_t *
+surface_from_pixbuf (GdkPixbuf *pixbuf)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+					      gdk_pixbuf_get_width (pixbuf),
+					      gdk_pixbuf_get_height (pixbuf));
+
+	cr = cairo_create (surface);
+	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	return surface;
+}
+
+/* Tiles are what one monitor shows. What gnome_bg_draw() puts on a
+ * monitor only depends on the monitor's size, not on where it is, so
+ * tiles are keyed by source, size and scale. When monitors come and
+ * go only the new sizes need rendering; the rest is pasted together
+ * from here. Tiles are shared by all screens of the process, so
+ * screens showing the same picture at the same size render it once.
+ */
+typedef struct {
+	cairo_surface_t *surface;
+	/* Screen -> that screen's generation when it last used the tile */
+	GHashTable *users;
+} Tile;
+
+/* Tiles not used by this many recent renders of any screen are dropped */
+#define TILE_GENERATIONS 2
+
+G_LOCK_DEFINE_STATIC (tiles);
+static GHashTable *tiles = NULL;
+/* Screen -> number of renders it has finished */
+static GHashTable *tiles_generations = NULL;
+/* Keys of tiles some thread is rendering right now */
+static GHashTable *tiles_pending = NULL;
+static GCond tiles_cond;
+
+static void
+tile_free (Tile *tile)
+{
+	cairo_surface_destroy (tile->surface);
+	g_hash_table_unref (tile->users);
+	g_slice_free (Tile, tile);
+}
+
+static void
+ensure_tiles (void)
+{
+	if (tiles == NULL) {
+		tiles = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, (GDestroyNotify) tile_free);
+		tiles_generations = g_hash_table_new (NULL, NULL);
+		tiles_pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, NULL);
+	}
+}
+
+/* Returns the tile for @key, or NULL, in which case the caller is
+ * to render it and hand it to release_tile(). If another thread is
+ * rendering the same tile, e.g. for another screen showing the same
+ * picture, waits for it rather than rendering it twice.
+ */
+static cairo_surface_t *
+claim_tile (const char *key)
+{
+	Tile *tile;
+	cairo_surface_t *surface = NULL;
+
+	G_LOCK (tiles);
+	ensure_tiles ();
+	while (g_hash_table_contains (tiles_pending, key)) {
+		g_cond_wait (&tiles_cond, &G_LOCK_NAME (tiles));
+	}
+
+	tile = g_hash_table_lookup (tiles, key);
+	if (tile != NULL) {
+		surface = cairo_surface_reference (tile->surface);
+	} else {
+		g_hash_table_add (tiles_pending, g_strdup (key));
+	}
+	G_UNLOCK (tiles);
+
+	return surface;
+}
+
+/* Publishes what claim_tile() asked for. @surface may be NULL if the
+ * render failed or was cancelled; a waiting thread then renders the
+ * tile itself.
+ */
+static void
+release_tile (const char *key,
+	      GdkScreen *screen,
+	      cairo_surface_t *surface)
+{
+	Tile *tile;
+
+	G_LOCK (tiles);
+	g_hash_table_remove (tiles_pending, key);
+
+	if (surface != NULL && !g_atomic_int_get (&low_memory)) {
+		tile = g_slice_new (Tile);
+		tile->surface = cairo_surface_reference (surface);
+		tile->users = g_hash_table_new (NULL, NULL);
+		/* Counts as used by the render that is running */
+		g_hash_table_insert (tile->users, screen,
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (tiles_generations, screen)) + 1));
+		g_hash_table_replace (tiles, g_strdup (key), tile);
+	}
+
+	g_cond_broadcast (&tiles_cond);
+	G_UNLOCK (tiles);
+}
+
+/* Drops users that have not used a tile for a while, and tiles that
+ * have no users left. Called with the lock held.
+ */
+static void
+prune_tiles (void)
+{
+	GHashTableIter iter, users;
+	gpointer key, value, screen, generation;
+	Tile *tile;
+	guint current;
+
+	g_hash_table_iter_init (&iter, tiles);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		tile = value;
+
+		g_hash_table_iter_init (&users, tile->users);
+		while (g_hash_table_iter_next (&users, &screen, &generation)) {
+			current = GPOINTER_TO_UINT (g_hash_table_lookup (tiles_generations, screen));
+			/* A tile published by a render still running is a
+			 * generation ahead.
+			 */
+			if (!g_hash_table_contains (tiles_generations, screen) ||
+			    (gint) (current - GPOINTER_TO_UINT (generation)) >= TILE_GENERATIONS) {
+				g_hash_table_iter_remove (&users);
+			}
+		}
+
+		if (g_hash_table_size (tile->users) == 0) {
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+}
+
+/* Keeps the tiles of the render that just finished on @screen and
+ * forgets those that have not been used for a while.
+ */
+static void
+update_tiles (GdkScreen *screen,
+	      GHashTable *used)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	Tile *tile;
+	guint generation;
+
+	G_LOCK (tiles);
+
+	ensure_tiles ();
+
+	generation = GPOINTER_TO_UINT (g_hash_table_lookup (tiles_generations, screen)) + 1;
+	g_hash_table_insert (tiles_generations, screen, GUINT_TO_POINTER (generation));
+
+	g_hash_table_iter_init (&iter, used);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		tile = g_hash_table_lookup (tiles, key);
+		if (tile == NULL) {
+			tile = g_slice_new (Tile);
+			tile->surface = cairo_surface_reference (value);
+			tile->users = g_hash_table_new (NULL, NULL);
+			g_hash_table_insert (tiles, g_strdup (key), tile);
+		}
+		g_hash_table_insert (tile->users, screen, GUINT_TO_POINTER (generation));
+	}
+
+	prune_tiles ();
+
+	G_UNLOCK (tiles);
+}
+
+static void
+clear_tiles (void)
+{
+	G_LOCK (tiles);
+	if (tiles != NULL) {
+		g_hash_table_remove_all (tiles);
+	}
+	G_UNLOCK (tiles);
+}
+
+static gsize
+get_tiles_size (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+	cairo_surface_t *surface;
+	gsize size = 0;
+
+	G_LOCK (tiles);
+	if (tiles != NULL) {
+		g_hash_table_iter_init (&iter, tiles);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			surface = ((Tile *) value)->surface;
+			size += (gsize) cairo_image_surface_get_stride (surface) *
+				cairo_image_surface_get_height (surface);
+		}
+	}
+	G_UNLOCK (tiles);
+
+	return size;
+}
+
+/* Places the picture the way gnome-bg does, but from a decode at
+ * the size it is shown at rather than at the size of the file, and
+ * scaled on all cores. Returns NULL if the placement keeps the
+ * picture at its own size, or if the picture can't be decoded;
+ * gnome-bg then draws the tile.
+ */
+static cairo_surface_t *
+draw_scaled_picture (NautilusBackgroundRenderJob *job,
+		     const char *filename,
+		     int width,
+		     int height)
+{
+	GdkPixbuf *picture, *colors;
+	cairo_surface_t *surface, *source, *placed;
+	cairo_t *cr;
+	double scale_x, scale_y, x, y;
+	int dest_x, dest_y, dest_width, dest_height;
+	gint64 start;
+
+	switch (job->placement) {
+	case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+	case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+	case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+	case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+		break;
+	default:
+		return NULL;
+	}
+
+	if (filename == NULL) {
+		return NULL;
+	}
+
+	start = nautilus_background_stats_begin ();
+	picture = nautilus_background_decode (filename, job->placement, width, height);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_DECODE, start);
+	if (picture == NULL) {
+		return NULL;
+	}
+
+	colors = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	if (colors == NULL) {
+		g_object_unref (picture);
+		return NULL;
+	}
+	gnome_bg_draw (job->color_bg, colors, job->screen, FALSE);
+	surface = surface_from_pixbuf (colors);
+	g_object_unref (colors);
+
+	scale_x = (double) width / gdk_pixbuf_get_width (picture);
+	scale_y = (double) height / gdk_pixbuf_get_height (picture);
+
+	switch (job->placement) {
+	case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+	case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+		scale_x = scale_y = MAX (scale_x, scale_y);
+		break;
+	case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+		scale_x = scale_y = MIN (scale_x, scale_y);
+		break;
+	default:
+		break;
+	}
+
+	/* Centered, cropped to the tile */
+	x = (width - gdk_pixbuf_get_width (picture) * scale_x) / 2;
+	y = (height - gdk_pixbuf_get_height (picture) * scale_y) / 2;
+	dest_x = MAX (0, (int) floor (x));
+	dest_y = MAX (0, (int) floor (y));
+	dest_width = MIN (width, (int) ceil (width - x)) - dest_x;
+	dest_height = MIN (height, (int) ceil (height - y)) - dest_y;
+
+	if (dest_width > 0 && dest_height > 0) {
+		/* ARGB32 throughout, the scaler keeps colours premultiplied */
+		source = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+						     gdk_pixbuf_get_width (picture),
+						     gdk_pixbuf_get_height (picture));
+		cr = cairo_create (source);
+		gdk_cairo_set_source_pixbuf (cr, picture, 0, 0);
+		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+
+		/* Lanczos keeps detail when shrinking, but rings when
+		 * enlarging, where bilinear is what gnome-bg uses.
+		 */
+		placed = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, dest_width, dest_height);
+		start = nautilus_background_stats_begin ();
+		nautilus_background_scale (source, placed,
+					   x - dest_x, y - dest_y,
+					   scale_x, scale_y,
+					   (scale_x < 1.0 || scale_y < 1.0) ?
+					   NAUTILUS_BACKGROUND_FILTER_LANCZOS :
+					   NAUTILUS_BACKGROUND_FILTER_BILINEAR);
+		nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_SCALE, start);
+		cairo_surface_destroy (source);
+
+		cr = cairo_create (surface);
+		cairo_set_source_surface (cr, placed, dest_x, dest_y);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+		cairo_surface_destroy (placed);
+	}
+	g_object_unref (picture);
+
+	return surface;
+}
+
+/* Centered or tiled, pixel for pixel, the way gnome-bg draws it.
+ * Slideshow pictures come here instead of going through a GnomeBG:
+ * pointing one at another file would have it set up file monitors
+ * and "changed" timeouts on the main context from this thread.
+ */
+static cairo_surface_t *
+draw_unscaled_picture (NautilusBackgroundRenderJob *job,
+		       const char *filename,
+		       int width,
+		       int height)
+{
+	GdkPixbuf *picture, *colors;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	gint64 start;
+
+	start = nautilus_background_stats_begin ();
+	picture = nautilus_background_decode (filename, job->placement, width, height);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_DECODE, start);
+	if (picture == NULL) {
+		return NULL;
+	}
+
+	colors = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	if (colors == NULL) {
+		g_object_unref (picture);
+		return NULL;
+	}
+	gnome_bg_draw (job->color_bg, colors, job->screen, FALSE);
+	surface = surface_from_pixbuf (colors);
+	g_object_unref (colors);
+
+	cr = cairo_create (surface);
+	if (job->placement == G_DESKTOP_BACKGROUND_STYLE_NONE) {
+		/* Only the colours show */
+	} else if (job->placement == G_DESKTOP_BACKGROUND_STYLE_WALLPAPER) {
+		gdk_cairo_set_source_pixbuf (cr, picture, 0, 0);
+		cairo_pattern_set_extend (cairo_get_source (cr), CAIRO_EXTEND_REPEAT);
+	} else {
+		gdk_cairo_set_source_pixbuf (cr, picture,
+					     (width - gdk_pixbuf_get_width (picture)) / 2,
+					     (height - gdk_pixbuf_get_height (picture)) / 2);
+	}
+	cairo_paint (cr);
+	cairo_destroy (cr);
+	g_object_unref (picture);
+
+	return surface;
+}
+
+static cairo_surface_t *
+draw_tile (NautilusBackgroundRenderJob *job,
+	   int width,
+	   int height)
+{
+	GdkPixbuf *pixbuf;
+	cairo_surface_t *surface;
+	gint64 start;
+
+	surface = draw_scaled_picture (job, job->filename, width, height);
+	if (surface != NULL) {
+		return surface;
+	}
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	if (pixbuf == NULL) {
+		return NULL;
+	}
+
+	/* Decoding is most of what gnome-bg does here */
+	start = nautilus_background_stats_begin ();
+	gnome_bg_draw (job->bg, pixbuf, job->screen, FALSE);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_DECODE, start);
+
+	surface = surface_from_pixbuf (pixbuf);
+	g_object_unref (pixbuf);
+
+	return surface;
+}
+
+/* One picture of a slideshow, placed on a tile of the given size.
+ * Looping slideshows show the same pictures over and over, so these
+ * are kept in the frame cache rather than decoded each time.
+ */
+static cairo_surface_t *
+get_frame (NautilusBackgroundRenderJob *job,
+	   const char *file,
+	   int width,
+	   int height)
+{
+	cairo_surface_t *frame;
+	GStatBuf buf;
+	char *key = NULL;
+
+	if (g_stat (file, &buf) == 0) {
+		key = g_strdup_printf ("%sframe=%s %" G_GINT64_FORMAT " %dx%d",
+				       job->settings_key, file,
+				       (gint64) buf.st_mtime, width, height);
+		frame = nautilus_background_frames_lookup (key);
+		if (frame != NULL) {
+			g_free (key);
+			return frame;
+		}
+	}
+
+	frame = draw_scaled_picture (job, file, width, height);
+	if (frame == NULL) {
+		frame = draw_unscaled_picture (job, file, width, height);
+	}
+
+	if (frame != NULL && key != NULL) {
+		nautilus_background_frames_insert (key, frame);
+	}
+	g_free (key);
+
+	return frame;
+}
+
+static cairo_surface_t *
+render_tile (NautilusBackgroundRenderJob *job,
+	     int width,
+	     int height)
+{
+	cairo_surface_t *frame, *next, *blended;
+	cairo_t *cr;
+	const char *file1, *file2;
+	double progress, duration;
+	gboolean is_fixed;
+
+	if (job->slide_show == NULL) {
+		return draw_tile (job, width, height);
+	}
+
+	gnome_bg_slide_show_get_current_slide (job->slide_show, width, height,
+					       &progress, &duration, &is_fixed,
+					       &file1, &file2);
+
+	frame = get_frame (job, file1, width, height);
+	if (frame == NULL || is_fixed || file2 == NULL) {
+		return frame;
+	}
+
+	/* In a transition, blend the two cached frames */
+	next = get_frame (job, file2, width, height);
+	if (next == NULL) {
+		return frame;
+	}
+
+	blended = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+	cr = cairo_create (blended);
+	cairo_set_source_surface (cr, frame, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_set_source_surface (cr, next, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+	cairo_paint_with_alpha (cr, progress);
+	cairo_destroy (cr);
+
+	cairo_surface_destroy (next);
+	cairo_surface_destroy (frame);
+
+	return blended;
+}
+
+/* The picture the slideshow moves to after the current one */
+static const char *
+get_next_file (GnomeBGSlideShow *show,
+	       int width,
+	       int height)
+{
+	const char *file1, *file2, *f1, *f2;
+	double progress, duration, p, d;
+	gboolean is_fixed, fixed;
+	int i, n;
+
+	gnome_bg_slide_show_get_current_slide (show, width, height,
+					       &progress, &duration, &is_fixed,
+					       &file1, &file2);
+	if (!is_fixed) {
+		return file2;
+	}
+
+	n = gnome_bg_slide_show_get_num_slides (show);
+	for (i = 0; i < n; i++) {
+		if (!gnome_bg_slide_show_get_slide (show, i, width, height,
+						    &p, &d, &fixed, &f1, &f2)) {
+			continue;
+		}
+		if (!fixed || d != duration || g_strcmp0 (f1, file1) != 0) {
+			continue;
+		}
+		if (!gnome_bg_slide_show_get_slide (show, (i + 1) % n, width, height,
+						    &p, &d, &fixed, &f1, &f2)) {
+			return NULL;
+		}
+		return fixed ? f1 : f2;
+	}
+
+	return NULL;
+}
+
+/* Decodes the next picture of the slideshow into the frame cache
+ * now, so that its transition only costs a blend.
+ */
+static void
+prefetch_next_slide (NautilusBackgroundRenderJob *job,
+		     const GdkRectangle *areas,
+		     int n_areas,
+		     GCancellable *cancellable)
+{
+	cairo_surface_t *frame;
+	const char *next;
+	int i;
+
+	for (i = 0; i < n_areas && !g_cancellable_is_cancelled (cancellable); i++) {
+		next = get_next_file (job->slide_show, areas[i].width, areas[i].height);
+		if (next == NULL) {
+			continue;
+		}
+
+		frame = get_frame (job, next, areas[i].width, areas[i].height);
+		if (frame != NULL) {
+			cairo_surface_destroy (frame);
+		}
+	}
+}
+
+/* Draws the picture once, on the background colour. Returns NULL if
+ * the picture turns out not to be a plain image, the full render
+ * then takes over.
+ */
+static cairo_surface_t *
+render_wallpaper_tile (NautilusBackgroundRenderJob *job,
+		       const char *source_key)
+{
+	cairo_surface_t *tile;
+	char *cache_key;
+	int width, height;
+
+	cache_key = g_strconcat (source_key, "wallpaper-tile\n",
+				 job->posterize ? "posterize\n" : "", NULL);
+	tile = nautilus_background_cache_lookup (cache_key);
+	if (tile != NULL) {
+		g_free (cache_key);
+		return tile;
+	}
+
+	if (gdk_pixbuf_get_file_info (job->filename, &width, &height) == NULL ||
+	    width <= 0 || height <= 0) {
+		g_free (cache_key);
+		return NULL;
+	}
+
+	/* Tiling starts at the top left corner of what is drawn, so
+	 * a picture-sized area holds exactly one tile.
+	 */
+	tile = draw_tile (job, width, height);
+	if (tile != NULL) {
+		if (job->posterize) {
+			nautilus_background_render_posterize (tile);
+		}
+		nautilus_background_cache_store (cache_key, tile);
+	}
+	g_free (cache_key);
+
+	return tile;
+}
+
+static void
+render_job (GTask *task,
+	    NautilusBackgroundRenderJob *job,
+	    GCancellable *cancellable)
+{
+	cairo_surface_t *surface, *tile;
+	cairo_t *cr;
+	GHashTable *used;
+	GdkRectangle whole = { 0, 0, job->width, job->height };
+	GdkRectangle *areas;
+	char *source_key, *cache_key = NULL, *tile_key;
+	int i, n_areas, scale;
+	gboolean claimed;
+
+	/* Previews skip the caches: looking the picture up costs a
+	 * read of the whole file, and the result is thrown away soon.
+	 */
+	source_key = job->preview ? NULL : get_source_key (job);
+
+	if (job->tile_once && source_key != NULL) {
+		surface = render_wallpaper_tile (job, source_key);
+		if (surface != NULL) {
+			g_free (source_key);
+			g_task_return_pointer (task, surface,
+					       (GDestroyNotify) cairo_surface_destroy);
+			return;
+		}
+	}
+
+	if (source_key != NULL) {
+		cache_key = get_cache_key (job, source_key);
+		surface = nautilus_background_cache_lookup (cache_key);
+		if (surface != NULL) {
+			nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_CACHE_HITS, 1);
+			g_free (cache_key);
+			g_free (source_key);
+			g_task_return_pointer (task, surface,
+					       (GDestroyNotify) cairo_surface_destroy);
+			return;
+		}
+	} else if (job->filename != NULL && !job->preview) {
+		job->slide_show = gnome_bg_slide_show_new (job->filename);
+		if (!gnome_bg_slide_show_load (job->slide_show, NULL)) {
+			g_clear_object (&job->slide_show);
+		}
+	}
+
+	if (job->target != NULL) {
+		surface = cairo_surface_reference (job->target);
+	} else {
+		surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+						      job->width, job->height);
+	}
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (surface);
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+					 "Could not allocate a %dx%d background",
+					 job->width, job->height);
+		g_free (cache_key);
+		g_free (source_key);
+		return;
+	}
+
+	/* Same layout gnome_bg_create_surface() uses for the root
+	 * window: each monitor gets its own copy of the image, unless
+	 * the image is meant to span all of them.
+	 */
+	if (job->placement == G_DESKTOP_BACKGROUND_STYLE_SPANNED ||
+	    job->n_monitors <= 1) {
+		areas = &whole;
+		n_areas = 1;
+	} else {
+		areas = job->monitors;
+		n_areas = job->n_monitors;
+	}
+
+	/* Areas not covered by any monitor stay black */
+	cr = cairo_create (surface);
+	cairo_set_source_rgb (cr, 0, 0, 0);
+	cairo_paint (cr);
+
+	/* Tiles used by this render, also shared between monitors of
+	 * the same size when the background can't be cached.
+	 */
+	used = g_hash_table_new_full (g_str_hash, g_str_equal,
+				      g_free, (GDestroyNotify) cairo_surface_destroy);
+
+	for (i = 0; i < n_areas && !g_cancellable_is_cancelled (cancellable); i++) {
+		scale = (areas == job->monitors) ? job->scales[i] : 1;
+		tile_key = g_strdup_printf ("%stile=%dx%d@%d",
+					    source_key ? source_key : "",
+					    areas[i].width, areas[i].height, scale);
+
+		claimed = FALSE;
+		tile = g_hash_table_lookup (used, tile_key);
+		if (tile != NULL) {
+			cairo_surface_reference (tile);
+		} else if (source_key != NULL) {
+			tile = claim_tile (tile_key);
+			claimed = tile == NULL;
+		}
+		if (tile == NULL) {
+			tile = render_tile (job, areas[i].width, areas[i].height);
+			if (claimed) {
+				release_tile (tile_key, job->screen, tile);
+			}
+		}
+
+		if (tile != NULL) {
+			cairo_set_source_surface (cr, tile, areas[i].x, areas[i].y);
+			cairo_rectangle (cr, areas[i].x, areas[i].y,
+					 areas[i].width, areas[i].height);
+			cairo_fill (cr);
+			g_hash_table_replace (used, tile_key, tile);
+		} else {
+			g_free (tile_key);
+		}
+	}
+
+	cairo_destroy (cr);
+
+	if (g_task_return_error_if_cancelled (task)) {
+		cairo_surface_destroy (surface);
+		g_hash_table_unref (used);
+		g_free (cache_key);
+		g_free (source_key);
+		return;
+	}
+
+	if (source_key != NULL && !g_atomic_int_get (&low_memory)) {
+		update_tiles (job->screen, used);
+	}
+	g_hash_table_unref (used);
+	g_free (source_key);
+
+	/* After the tiles, which stay full quality for other screens */
+	if (job->posterize) {
+		nautilus_background_render_posterize (surface);
+	}
+
+	/* Hand the surface over first, writing it out can take a while */
+	g_task_return_pointer (task, cairo_surface_reference (surface),
+			       (GDestroyNotify) cairo_surface_destroy);
+
+	if (cache_key != NULL) {
+		nautilus_background_cache_store (cache_key, surface);
+		g_free (cache_key);
+	}
+
+	if (job->slide_show != NULL && !g_atomic_int_get (&low_memory)) {
+		prefetch_next_slide (job, areas, n_areas, cancellable);
+	}
+
+	cairo_surface_destroy (surface);
+}
+
+/* The span includes writing to the disk cache and prefetching, which
+ * happen after the surface is handed over.
+ */
+static void
+render_thread (GTask *task,
+	       gpointer source_object,
+	       gpointer task_data,
+	       GCancellable *cancellable)
+{
+	gint64 start;
+
+	start = nautilus_background_stats_begin ();
+	render_job (task, task_data, cancellable);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_RENDER, start);
+}
+
+void
+nautilus_background_render_job_run_async (NautilusBackgroundRenderJob *job,
+					  GCancellable *cancellable,
+					  GAsyncReadyCallback callback,
+					  gpointer user_data)
+{
+	GTask *task;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, nautilus_background_render_job_run_async);
+	g_task_set_task_data (task, job,
+			      (GDestroyNotify) nautilus_background_render_job_free);
+	g_task_run_in_thread (task, render_thread);
+	g_object_unref (task);
+}
+
+cairo_surface_t *
+nautilus_background_render_job_finish (GAsyncResult *result,
+				       GError **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Keeps the top four bits of each channel and repeats them below,
+ * so white stays white.
+ */
+void
+nautilus_background_render_posterize (cairo_surface_t *image)
+{
+	guchar *data;
+	guint32 *row;
+	int x, y, width, height, stride;
+
+	g_return_if_fail (cairo_image_surface_get_format (image) == CAIRO_FORMAT_RGB24);
+
+	cairo_surface_flush (image);
+	data = cairo_image_surface_get_data (image);
+	width = cairo_image_surface_get_width (image);
+	height = cairo_image_surface_get_height (image);
+	stride = cairo_image_surface_get_stride (image);
+
+	for (y = 0; y < height; y++) {
+		row = (guint32 *) (data + y * stride);
+		for (x = 0; x < width; x++) {
+			row[x] &= 0xf0f0f0;
+			row[x] |= row[x] >> 4;
+		}
+	}
+	cairo_surface_mark_dirty (image);
+}
+
+/* Copies @image into the xlib surface @target, the cheapest way the
+ * server allows.
+ */
+static void
+put_image (GdkScreen *screen,
+	   cairo_surface_t *image,
+	   cairo_surface_t *target)
+{
+	cairo_surface_t *shared;
+	cairo_t *cr;
+	gboolean uploaded;
+	int width, height;
+
+	width = cairo_image_surface_get_width (image);
+	height = cairo_image_surface_get_height (image);
+
+	/* Rendered straight into shared memory: the server copies
+	 * it into the pixmap without anything going over the socket.
+	 */
+	if (nautilus_background_xshm_put (image, target)) {
+		return;
+	}
+
+	/* From a cache hit, say. A local copy into shared memory is
+	 * still far cheaper than pushing the pixels through the socket.
+	 */
+	shared = nautilus_background_xshm_surface_new (screen, width, height);
+	if (shared != NULL) {
+		cr = cairo_create (shared);
+		cairo_set_source_surface (cr, image, 0, 0);
+		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+
+		uploaded = nautilus_background_xshm_put (shared, target);
+		cairo_surface_destroy (shared);
+
+		if (uploaded) {
+			return;
+		}
+	}
+
+	cr = cairo_create (target);
+	cairo_set_source_surface (cr, image, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_BYTES_SENT,
+				       (guint64) cairo_image_surface_get_stride (image) * height);
+	g_debug ("Sent %dx%d background over the X socket, %" G_GUINT64_FORMAT " bytes so far",
+		 width, height,
+		 nautilus_background_stats_get (NAUTILUS_BACKGROUND_COUNTER_BYTES_SENT));
+}
+
+typedef struct {
+	GdkDisplay *display;
+	Pixmap pixmap;
+	gboolean is_root;
+} RetainedPixmap;
+
+static cairo_user_data_key_t retained_pixmap_key;
+
+/* Unless it went up as root, nobody else knows the pixmap, so it
+ * goes with the surface. Retained surfaces never leave the main
+ * thread. A closed display lost its server, and the pixmap with it.
+ */
+static void
+retained_pixmap_free (gpointer data)
+{
+	RetainedPixmap *retained = data;
+
+	if (!retained->is_root && !gdk_display_is_closed (retained->display)) {
+		gdk_error_trap_push ();
+		XKillClient (GDK_DISPLAY_XDISPLAY (retained->display), retained->pixmap);
+		gdk_error_trap_pop_ignored ();
+	}
+
+	g_object_unref (retained->display);
+	g_slice_free (RetainedPixmap, retained);
+}
+
+/* The pixmap is created from a throwaway connection, exactly like
+ * gnome-bg does, so that it survives us and so that window managers
+ * that kill the old owner of _XROOTPMAP_ID do not take us down with
+ * it. The connection is its own client, so killing it frees the
+ * pixmap and nothing else.
+ */
+static cairo_surface_t *
+create_retained_surface (GdkWindow *window,
+			 int width,
+			 int height)
+{
+	GdkScreen *screen;
+	Display *display;
+	const char *display_name;
+	Pixmap pixmap;
+	RetainedPixmap *retained;
+	cairo_surface_t *surface;
+	int screen_num;
+
+	screen = gdk_window_get_screen (window);
+	screen_num = gdk_screen_get_number (screen);
+
+	gdk_flush ();
+
+	display_name = DisplayString (GDK_WINDOW_XDISPLAY (window));
+	display = XOpenDisplay (display_name);
+	if (display == NULL) {
+		g_warning ("Unable to open display '%s' when setting background pixmap",
+			   display_name ? display_name : "NULL");
+		return NULL;
+	}
+
+	XSetCloseDownMode (display, RetainPermanent);
+	pixmap = XCreatePixmap (display, RootWindow (display, screen_num),
+				width, height,
+				DefaultDepth (display, screen_num));
+	XCloseDisplay (display);
+
+	surface = cairo_xlib_surface_create (GDK_SCREEN_XDISPLAY (screen),
+					     pixmap,
+					     GDK_VISUAL_XVISUAL (gdk_screen_get_system_visual (screen)),
+					     width, height);
+
+	retained = g_slice_new0 (RetainedPixmap);
+	retained->display = g_object_ref (gdk_screen_get_display (screen));
+	retained->pixmap = pixmap;
+	cairo_surface_set_user_data (surface, &retained_pixmap_key,
+				     retained, retained_pixmap_free);
+
+	return surface;
+}
+
+void
+nautilus_background_render_set_root (cairo_surface_t *surface)
+{
+	RetainedPixmap *retained;
+
+	retained = cairo_surface_get_user_data (surface, &retained_pixmap_key);
+	if (retained != NULL) {
+		retained->is_root = TRUE;
+	}
+}
+
+/* Only the image itself goes to the server; stretching it over the
+ * pixmap, or repeating it, happens there.
+ */
+static cairo_surface_t *
+upload_small_image (GdkWindow *window,
+		    cairo_surface_t *image)
+{
+	cairo_surface_t *small;
+
+	small = gdk_window_create_similar_surface (window, CAIRO_CONTENT_COLOR,
+						   cairo_image_surface_get_width (image),
+						   cairo_image_surface_get_height (image));
+	put_image (gdk_window_get_screen (window), image, small);
+
+	return small;
+}
+
+cairo_surface_t *
+nautilus_background_render_upload (GdkWindow *window,
+				   cairo_surface_t *image,
+				   int width,
+				   int height)
+{
+	cairo_surface_t *surface, *tile;
+	cairo_pattern_t *pattern;
+	cairo_t *cr;
+	gint64 start;
+
+	start = nautilus_background_stats_begin ();
+
+	surface = create_retained_surface (window, width, height);
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	if (cairo_image_surface_get_width (image) == width &&
+	    cairo_image_surface_get_height (image) == height) {
+		put_image (gdk_window_get_screen (window), image, surface);
+		nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_UPLOAD, start);
+		return surface;
+	}
+
+	/* A single tile: the pixmap itself stays the size of the
+	 * screen, since clients reading _XROOTPMAP_ID for
+	 * pseudo-transparency expect that.
+	 */
+	tile = upload_small_image (window, image);
+
+	pattern = cairo_pattern_create_for_surface (tile);
+	cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
+
+	cr = cairo_create (surface);
+	cairo_set_source (cr, pattern);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	cairo_pattern_destroy (pattern);
+	cairo_surface_destroy (tile);
+
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_UPLOAD, start);
+
+	return surface;
+}
+
+cairo_surface_t *
+nautilus_background_render_upload_preview (GdkWindow *window,
+					   cairo_surface_t *image,
+					   int width,
+					   int height)
+{
+	cairo_surface_t *surface, *small;
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	cairo_t *cr;
+	gint64 start;
+
+	start = nautilus_background_stats_begin ();
+
+	surface = create_retained_surface (window, width, height);
+	if (surface == NULL) {
+		return NULL;
+	}
+
+	small = upload_small_image (window, image);
+
+	pattern = cairo_pattern_create_for_surface (small);
+	cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
+	cairo_pattern_set_filter (pattern, CAIRO_FILTER_BILINEAR);
+	cairo_matrix_init_scale (&matrix,
+				 (double) cairo_image_surface_get_width (image) / width,
+				 (double) cairo_image_surface_get_height (image) / height);
+	cairo_pattern_set_matrix (pattern, &matrix);
+
+	cr = cairo_create (surface);
+	cairo_set_source (cr, pattern);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	cairo_pattern_destroy (pattern);
+	cairo_surface_destroy (small);
+
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_UPLOAD, start);
+
+	return surface;
+}
+
+guint64
+nautilus_background_render_get_bytes_sent (void)
+{
+	return nautilus_background_stats_get (NAUTILUS_BACKGROUND_COUNTER_BYTES_SENT);
+}
+
+void
+nautilus_background_render_set_low_memory (gboolean enabled)
+{
+	g_atomic_int_set (&low_memory, enabled);
+
+	if (enabled) {
+		clear_tiles ();
+		nautilus_background_frames_set_budget (0);
+	} else {
+		nautilus_background_frames_set_budget (NAUTILUS_BACKGROUND_FRAMES_DEFAULT_BUDGET);
+	}
+}
+
+void
+nautilus_background_render_release_caches (void)
+{
+	clear_tiles ();
+	nautilus_background_frames_clear ();
+}
+
+void
+nautilus_background_render_forget_screen (GdkScreen *screen)
+{
+	G_LOCK (tiles);
+	if (tiles != NULL) {
+		g_hash_table_remove (tiles_generations, screen);
+		prune_tiles ();
+	}
+	G_UNLOCK (tiles);
+}
+
+gsize
+nautilus_background_render_get_cached_bytes (void)
+{
+	return get_tiles_size () + nautilus_background_frames_get_size ();
+}
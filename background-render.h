@@ -0,0 +1,127 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-render.h: Renders desktop backgrounds off the main thread.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_RENDER_H__
+#define __NAUTILUS_BACKGROUND_RENDER_H__
+
+#include <gtk/gtk.h>
+
+typedef struct NautilusBackgroundRenderJob NautilusBackgroundRenderJob;
+
+/* A render job is a snapshot of everything needed to draw the
+ * background: the settings and the monitor layout of the screen. It
+ * is created on the main thread and then drawn on a worker thread,
+ * so nothing the job uses is shared with the rest of the program.
+ */
+NautilusBackgroundRenderJob *nautilus_background_render_job_new       (GSettings                   *settings,
+								       GdkScreen                   *screen);
+void                         nautilus_background_render_job_free      (NautilusBackgroundRenderJob *job);
+
+/* The job composes into @target instead of a surface of its own.
+ * @target must be an image surface the size of the screen.
+ */
+void                         nautilus_background_render_job_set_target (NautilusBackgroundRenderJob *job,
+									 cairo_surface_t             *target);
+gboolean                     nautilus_background_render_job_is_tiled  (NautilusBackgroundRenderJob *job);
+
+/* Renders with 16 levels per channel, which VNC and similar encode
+ * as large runs of few colours. Posterized renders are cached apart
+ * from full ones.
+ */
+void                         nautilus_background_render_job_set_posterize (NautilusBackgroundRenderJob *job,
+									   gboolean                     posterize);
+
+/* Turns the job into a preview: everything @divisor times smaller,
+ * no caches involved. Returns FALSE, leaving the job as it was, if a
+ * preview would not be much quicker than the real thing.
+ */
+gboolean                     nautilus_background_render_job_set_preview (NautilusBackgroundRenderJob *job,
+									 int                          divisor);
+void                         nautilus_background_render_job_get_size  (NautilusBackgroundRenderJob *job,
+								       int                         *width,
+								       int                         *height);
+/* A short string that identifies what the job will draw, or NULL for
+ * previews and backgrounds that change with time.
+ */
+char                        *nautilus_background_render_job_get_key   (NautilusBackgroundRenderJob *job);
+
+/* Takes ownership of @job. The result is a client-side image surface,
+ * the size of the screen or, for tiled jobs, of a single tile.
+ */
+void                         nautilus_background_render_job_run_async (NautilusBackgroundRenderJob *job,
+								       GCancellable                *cancellable,
+								       GAsyncReadyCallback          callback,
+								       gpointer                     user_data);
+cairo_surface_t             *nautilus_background_render_job_finish    (GAsyncResult                *result,
+								       GError                     **error);
+
+/* Copies a rendered image into a new @width x @height pixmap that
+ * can outlive this process, suitable for gnome_bg_set_surface_as_root().
+ * A smaller image is a tile and gets repeated. Must be called on the
+ * main thread. MIT-SHM is used when the server is local; otherwise
+ * the pixels go over the socket, and are counted.
+ */
+cairo_surface_t             *nautilus_background_render_upload        (GdkWindow                   *window,
+								       cairo_surface_t             *image,
+								       int                          width,
+								       int                          height);
+/* Same, but stretches the small image of a preview job over the
+ * pixmap. Only the small image is uploaded.
+ */
+cairo_surface_t             *nautilus_background_render_upload_preview (GdkWindow                   *window,
+									 cairo_surface_t             *image,
+									 int                          width,
+									 int                          height);
+/* The pixmap of an uploaded surface is freed along with the surface,
+ * unless the surface is marked here after being set as root. The
+ * next gnome_bg_set_surface_as_root() frees it then.
+ */
+void                         nautilus_background_render_set_root      (cairo_surface_t             *surface);
+guint64                      nautilus_background_render_get_bytes_sent (void);
+
+/* In low-memory mode nothing that has been pushed to the server is
+ * kept on the client: rendered tiles and slideshow frames are dropped
+ * as soon as a render is done with them.
+ */
+void                         nautilus_background_render_set_low_memory (gboolean                     low_memory);
+
+/* Drops every tile and slideshow frame held on the client, e.g.
+ * when the system runs short of memory. The next render decodes
+ * them again, or finds them in the disk cache.
+ */
+void                         nautilus_background_render_release_caches (void);
+
+/* Tiles are shared by all screens of the process. Lets go of those
+ * only @screen was using, e.g. because its display was closed.
+ */
+void                         nautilus_background_render_forget_screen (GdkScreen                  *screen);
+
+/* Posterizes an RGB24 image surface in place */
+void                         nautilus_background_render_posterize     (cairo_surface_t             *image);
+
+/* Bytes of pixel data held in the tile and frame caches */
+gsize                        nautilus_background_render_get_cached_bytes (void);
+
+#endif /* __NAUTILUS_BACKGROUND_RENDER_H__ */
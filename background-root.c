@@ -0,0 +1,206 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-root.c: Remembers which render is on the root window.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-root.h"
+
+#include <cairo-xlib.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <string.h>
+
+#define ROOT_KEY_PROPERTY "_NAUTILUS_BACKGROUND_KEY"
+
+/* The key is stored along with the pixmap it was written for, so a
+ * root pixmap set by anybody else won't match.
+ */
+static char *
+format_value (Pixmap pixmap,
+	      const char *key)
+{
+	return g_strdup_printf ("%lx %s", (unsigned long) pixmap, key);
+}
+
+static Atom
+get_atom (GdkScreen *screen,
+	  const char *name)
+{
+	return gdk_x11_get_xatom_by_name_for_display (gdk_screen_get_display (screen), name);
+}
+
+static gboolean
+get_root_pixmap (GdkScreen *screen,
+		 Pixmap *pixmap)
+{
+	Display *display = GDK_SCREEN_XDISPLAY (screen);
+	Window root = GDK_WINDOW_XID (gdk_screen_get_root_window (screen));
+	Atom type;
+	int format;
+	unsigned long n_items, bytes_after;
+	unsigned char *data = NULL;
+	gboolean found = FALSE;
+
+	gdk_error_trap_push ();
+	if (XGetWindowProperty (display, root,
+				get_atom (screen, "_XROOTPMAP_ID"),
+				0, 1, False, XA_PIXMAP,
+				&type, &format, &n_items, &bytes_after,
+				&data) == Success &&
+	    type == XA_PIXMAP && format == 32 && n_items == 1) {
+		*pixmap = *(Pixmap *) data;
+		found = TRUE;
+	}
+	gdk_error_trap_pop_ignored ();
+
+	if (data != NULL) {
+		XFree (data);
+	}
+
+	return found;
+}
+
+static char *
+get_root_key (GdkScreen *screen)
+{
+	Display *display = GDK_SCREEN_XDISPLAY (screen);
+	Window root = GDK_WINDOW_XID (gdk_screen_get_root_window (screen));
+	Atom type;
+	int format;
+	unsigned long n_items, bytes_after;
+	unsigned char *data = NULL;
+	char *value = NULL;
+
+	gdk_error_trap_push ();
+	if (XGetWindowProperty (display, root,
+				get_atom (screen, ROOT_KEY_PROPERTY),
+				0, 256, False,
+				get_atom (screen, "UTF8_STRING"),
+				&type, &format, &n_items, &bytes_after,
+				&data) == Success &&
+	    format == 8 && bytes_after == 0 && data != NULL) {
+		value = g_strndup ((const char *) data, n_items);
+	}
+	gdk_error_trap_pop_ignored ();
+
+	if (data != NULL) {
+		XFree (data);
+	}
+
+	return value;
+}
+
+void
+nautilus_background_root_set_key (GdkScreen *screen,
+				  cairo_surface_t *surface,
+				  const char *key)
+{
+	Display *display;
+	Window root;
+	Atom property;
+	char *value;
+
+	display = GDK_SCREEN_XDISPLAY (screen);
+	root = GDK_WINDOW_XID (gdk_screen_get_root_window (screen));
+	property = get_atom (screen, ROOT_KEY_PROPERTY);
+
+	if (key == NULL ||
+	    cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_XLIB) {
+		XDeleteProperty (display, root, property);
+		return;
+	}
+
+	value = format_value (cairo_xlib_surface_get_drawable (surface), key);
+	XChangeProperty (display, root, property,
+			 get_atom (screen, "UTF8_STRING"), 8,
+			 PropModeReplace, (guchar *) value, strlen (value));
+	g_free (value);
+}
+
+gboolean
+nautilus_background_root_is_current (GdkScreen *screen,
+				     cairo_surface_t *surface)
+{
+	Pixmap pixmap;
+
+	if (surface == NULL ||
+	    cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_XLIB ||
+	    !get_root_pixmap (screen, &pixmap)) {
+		return FALSE;
+	}
+
+	return cairo_xlib_surface_get_drawable (surface) == pixmap;
+}
+
+cairo_surface_t *
+nautilus_background_root_adopt (GdkScreen *screen,
+				const char *key,
+				int width,
+				int height)
+{
+	Display *display;
+	Window geometry_root;
+	Pixmap pixmap;
+	int x, y;
+	unsigned int pixmap_width, pixmap_height, border, depth;
+	char *value, *expected;
+	gboolean matches;
+	Status status;
+
+	display = GDK_SCREEN_XDISPLAY (screen);
+
+	if (!get_root_pixmap (screen, &pixmap)) {
+		return NULL;
+	}
+
+	value = get_root_key (screen);
+	expected = format_value (pixmap, key);
+	matches = g_strcmp0 (value, expected) == 0;
+	g_free (expected);
+	g_free (value);
+
+	if (!matches) {
+		return NULL;
+	}
+
+	/* The key could have outlived its pixmap, e.g. after the
+	 * retained client was killed.
+	 */
+	gdk_error_trap_push ();
+	status = XGetGeometry (display, pixmap, &geometry_root, &x, &y,
+			       &pixmap_width, &pixmap_height, &border, &depth);
+	if (gdk_error_trap_pop () != 0 || status == 0) {
+		return NULL;
+	}
+
+	if ((int) pixmap_width != width || (int) pixmap_height != height ||
+	    (int) depth != DefaultDepth (display, gdk_screen_get_number (screen))) {
+		return NULL;
+	}
+
+	return cairo_xlib_surface_create (display,
+					  pixmap,
+					  GDK_VISUAL_XVISUAL (gdk_screen_get_system_visual (screen)),
+					  width, height);
+}
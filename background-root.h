@@ -0,0 +1,56 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-root.h: Remembers which render is on the root window.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_ROOT_H__
+#define __NAUTILUS_BACKGROUND_ROOT_H__
+
+#include <gtk/gtk.h>
+
+/* Next to _XROOTPMAP_ID we keep the render key of the pixmap it
+ * names, so a later run can tell whether that pixmap is still what
+ * it would draw. A NULL @key says the pixmap matches nothing, e.g.
+ * because it is only a preview.
+ */
+void             nautilus_background_root_set_key (GdkScreen       *screen,
+						   cairo_surface_t *surface,
+						   const char      *key);
+
+/* Returns the current root pixmap if it was installed with @key and
+ * is @width x @height, NULL otherwise. Nothing is copied: the surface
+ * is the root pixmap itself.
+ */
+cairo_surface_t *nautilus_background_root_adopt   (GdkScreen       *screen,
+						   const char      *key,
+						   int              width,
+						   int              height);
+
+/* Whether @surface is the pixmap _XROOTPMAP_ID names, e.g. because
+ * it was adopted. Setting it as root again would have gnome-bg kill
+ * the client that retains it, and with it the pixmap itself.
+ */
+gboolean         nautilus_background_root_is_current (GdkScreen       *screen,
+						      cairo_surface_t *surface);
+
+#endif /* __NAUTILUS_BACKGROUND_ROOT_H__ */
@@ -0,0 +1,625 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-scale.c: Multi-threaded image scaling for placed pictures.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#include "background-scale.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_SSE2_KERNELS 1
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON_KERNELS 1
+#include <arm_neon.h>
+#endif
+
+/* Weights are fixed point, summing up to 1 << WEIGHT_BITS. Lanczos
+ * lobes are negative, so they are signed 16-bit.
+ */
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+/* Fewer rows than this per band aren't worth a thread */
+#define MIN_BAND_HEIGHT 32
+
+/* For each output pixel along one axis: the first input pixel and
+ * the weights of it and the ones after it.
+ */
+typedef struct {
+	int n_taps;
+	int *start;
+	int *count;
+	gint16 *weights;
+} Contribs;
+
+typedef void (* FilterRowFunc)    (const guint32  *src,
+				   guint32        *dest,
+				   int             width,
+				   const Contribs *contribs);
+typedef void (* FilterColumnFunc) (const guint32 **rows,
+				   const gint16   *weights,
+				   int             n_rows,
+				   guint32        *dest,
+				   int             width);
+
+typedef struct {
+	const guchar *src;
+	int src_stride;
+	guchar *dest;
+	int dest_width;
+	int dest_stride;
+	Contribs *x;
+	Contribs *y;
+
+	GMutex lock;
+	GCond cond;
+	int pending;
+} ScaleJob;
+
+typedef struct {
+	ScaleJob *job;
+	int y0;
+	int y1;
+} Band;
+
+static FilterRowFunc filter_row;
+static FilterColumnFunc filter_column;
+static GThreadPool *pool;
+
+static double
+sinc (double x)
+{
+	if (x == 0.0) {
+		return 1.0;
+	}
+	x *= G_PI;
+	return sin (x) / x;
+}
+
+static double
+filter_kernel (NautilusBackgroundFilter filter,
+	       double x)
+{
+	x = fabs (x);
+
+	if (filter == NAUTILUS_BACKGROUND_FILTER_LANCZOS) {
+		return x < 3.0 ? sinc (x) * sinc (x / 3.0) : 0.0;
+	}
+
+	return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static Contribs *
+contribs_new (int src_length,
+	      int dest_length,
+	      double offset,
+	      double scale,
+	      NautilusBackgroundFilter filter)
+{
+	Contribs *contribs;
+	double *raw, radius, support, center, total, weight;
+	gint16 *w;
+	int d, i, j, first, last, start, end, sum, best;
+
+	radius = (filter == NAUTILUS_BACKGROUND_FILTER_LANCZOS) ? 3.0 : 1.0;
+	support = (scale < 1.0) ? radius / scale : radius;
+
+	contribs = g_slice_new (Contribs);
+	contribs->n_taps = (int) ceil (support) * 2 + 1;
+	contribs->start = g_new (int, dest_length);
+	contribs->count = g_new (int, dest_length);
+	contribs->weights = g_new0 (gint16, (gsize) dest_length * contribs->n_taps);
+
+	raw = g_new (double, contribs->n_taps);
+
+	for (d = 0; d < dest_length; d++) {
+		/* Pixel centres are at .5 */
+		center = (d + 0.5 - offset) / scale - 0.5;
+		first = (int) ceil (center - support);
+		last = MIN ((int) floor (center + support), first + contribs->n_taps - 1);
+
+		start = CLAMP (first, 0, src_length - 1);
+		end = CLAMP (last, 0, src_length - 1);
+
+		/* Taps past the edges count for the edge pixel */
+		memset (raw, 0, contribs->n_taps * sizeof (double));
+		total = 0.0;
+		for (j = first; j <= last; j++) {
+			weight = filter_kernel (filter, (j - center) * MIN (scale, 1.0));
+			raw[CLAMP (j, 0, src_length - 1) - start] += weight;
+			total += weight;
+		}
+		if (total == 0.0) {
+			raw[CLAMP ((int) floor (center + 0.5), start, end) - start] = 1.0;
+			total = 1.0;
+		}
+
+		w = contribs->weights + (gsize) d * contribs->n_taps;
+		sum = 0;
+		best = 0;
+		for (i = 0; i <= end - start; i++) {
+			w[i] = (gint16) lrint (raw[i] / total * WEIGHT_ONE);
+			sum += w[i];
+			if (w[i] > w[best]) {
+				best = i;
+			}
+		}
+		/* Rounding must not change the brightness */
+		w[best] += WEIGHT_ONE - sum;
+
+		contribs->start[d] = start;
+		contribs->count[d] = end - start + 1;
+	}
+
+	g_free (raw);
+
+	return contribs;
+}
+
+static void
+contribs_free (Contribs *contribs)
+{
+	g_free (contribs->start);
+	g_free (contribs->count);
+	g_free (contribs->weights);
+	g_slice_free (Contribs, contribs);
+}
+
+static inline int
+clamp_channel (int sum,
+	       int max)
+{
+	sum = (sum + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+	return CLAMP (sum, 0, max);
+}
+
+/* Premultiplied: no colour can end up brighter than its alpha */
+static inline guint32
+pack_pixel (int a,
+	    int r,
+	    int g,
+	    int b)
+{
+	a = clamp_channel (a, 255);
+	r = clamp_channel (r, a);
+	g = clamp_channel (g, a);
+	b = clamp_channel (b, a);
+
+	return ((guint32) a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void
+filter_row_scalar (const guint32 *src,
+		   guint32 *dest,
+		   int width,
+		   const Contribs *contribs)
+{
+	const guint32 *s;
+	const gint16 *w;
+	guint32 p;
+	int x, k, a, r, g, b;
+
+	for (x = 0; x < width; x++) {
+		s = src + contribs->start[x];
+		w = contribs->weights + (gsize) x * contribs->n_taps;
+		a = r = g = b = 0;
+
+		for (k = 0; k < contribs->count[x]; k++) {
+			p = s[k];
+			a += (p >> 24) * w[k];
+			r += ((p >> 16) & 0xff) * w[k];
+			g += ((p >> 8) & 0xff) * w[k];
+			b += (p & 0xff) * w[k];
+		}
+
+		dest[x] = pack_pixel (a, r, g, b);
+	}
+}
+
+static void
+filter_column_scalar (const guint32 **rows,
+		      const gint16 *weights,
+		      int n_rows,
+		      guint32 *dest,
+		      int width)
+{
+	guint32 p;
+	int x, k, a, r, g, b;
+
+	for (x = 0; x < width; x++) {
+		a = r = g = b = 0;
+
+		for (k = 0; k < n_rows; k++) {
+			p = rows[k][x];
+			a += (p >> 24) * weights[k];
+			r += ((p >> 16) & 0xff) * weights[k];
+			g += ((p >> 8) & 0xff) * weights[k];
+			b += (p & 0xff) * weights[k];
+		}
+
+		dest[x] = pack_pixel (a, r, g, b);
+	}
+}
+
+#ifdef HAVE_SSE2_KERNELS
+
+/* Two weights, one per 16-bit half, for _mm_madd_epi16() */
+#define WEIGHT_PAIR(w0, w1) \
+	_mm_set1_epi32 ((int) ((guint32) (guint16) (w0) | ((guint32) (guint16) (w1) << 16)))
+
+/* Four 32-bit sums per pixel, in memory order, down to 16-bit
+ * channels clamped to 0..alpha.
+ */
+__attribute__ ((target ("sse2")))
+static inline __m128i
+pack_sums_sse2 (__m128i lo,
+		__m128i hi)
+{
+	__m128i round, v, alpha;
+
+	round = _mm_set1_epi32 (WEIGHT_ONE / 2);
+	lo = _mm_srai_epi32 (_mm_add_epi32 (lo, round), WEIGHT_BITS);
+	hi = _mm_srai_epi32 (_mm_add_epi32 (hi, round), WEIGHT_BITS);
+
+	v = _mm_packs_epi32 (lo, hi);
+	v = _mm_max_epi16 (v, _mm_setzero_si128 ());
+	v = _mm_min_epi16 (v, _mm_set1_epi16 (255));
+
+	alpha = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (3, 3, 3, 3));
+	alpha = _mm_shufflehi_epi16 (alpha, _MM_SHUFFLE (3, 3, 3, 3));
+
+	return _mm_min_epi16 (v, alpha);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+filter_row_sse2 (const guint32 *src,
+		 guint32 *dest,
+		 int width,
+		 const Contribs *contribs)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const guint32 *s;
+	const gint16 *w;
+	__m128i acc, p;
+	int x, k, n;
+
+	for (x = 0; x < width; x++) {
+		s = src + contribs->start[x];
+		w = contribs->weights + (gsize) x * contribs->n_taps;
+		n = contribs->count[x];
+		acc = zero;
+
+		for (k = 0; k + 1 < n; k += 2) {
+			/* b0 g0 r0 a0 b1 g1 r1 a1 -> b0 b1 g0 g1 r0 r1 a0 a1 */
+			p = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (s + k)), zero);
+			p = _mm_unpacklo_epi16 (p, _mm_srli_si128 (p, 8));
+			acc = _mm_add_epi32 (acc, _mm_madd_epi16 (p, WEIGHT_PAIR (w[k], w[k + 1])));
+		}
+		if (k < n) {
+			p = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 ((int) s[k]), zero);
+			p = _mm_unpacklo_epi16 (p, zero);
+			acc = _mm_add_epi32 (acc, _mm_madd_epi16 (p, WEIGHT_PAIR (w[k], 0)));
+		}
+
+		p = pack_sums_sse2 (acc, acc);
+		dest[x] = (guint32) _mm_cvtsi128_si32 (_mm_packus_epi16 (p, p));
+	}
+}
+
+__attribute__ ((target ("sse2")))
+static void
+filter_column_sse2 (const guint32 **rows,
+		    const gint16 *weights,
+		    int n_rows,
+		    guint32 *dest,
+		    int width)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	__m128i acc0, acc1, acc2, acc3, a, b, lo, hi, wv;
+	int x, k;
+
+	for (x = 0; x + 4 <= width; x += 4) {
+		acc0 = acc1 = acc2 = acc3 = zero;
+
+		/* Two rows at a time: interleaving them puts the two
+		 * values of each channel next to each other.
+		 */
+		for (k = 0; k < n_rows; k += 2) {
+			a = _mm_loadu_si128 ((const __m128i *) (rows[k] + x));
+			if (k + 1 < n_rows) {
+				b = _mm_loadu_si128 ((const __m128i *) (rows[k + 1] + x));
+				wv = WEIGHT_PAIR (weights[k], weights[k + 1]);
+			} else {
+				b = zero;
+				wv = WEIGHT_PAIR (weights[k], 0);
+			}
+
+			lo = _mm_unpacklo_epi8 (a, b);
+			hi = _mm_unpackhi_epi8 (a, b);
+			acc0 = _mm_add_epi32 (acc0, _mm_madd_epi16 (_mm_unpacklo_epi8 (lo, zero), wv));
+			acc1 = _mm_add_epi32 (acc1, _mm_madd_epi16 (_mm_unpackhi_epi8 (lo, zero), wv));
+			acc2 = _mm_add_epi32 (acc2, _mm_madd_epi16 (_mm_unpacklo_epi8 (hi, zero), wv));
+			acc3 = _mm_add_epi32 (acc3, _mm_madd_epi16 (_mm_unpackhi_epi8 (hi, zero), wv));
+		}
+
+		_mm_storeu_si128 ((__m128i *) (dest + x),
+				  _mm_packus_epi16 (pack_sums_sse2 (acc0, acc1),
+						    pack_sums_sse2 (acc2, acc3)));
+	}
+
+	if (x < width) {
+		const guint32 **tail = g_newa (const guint32 *, MAX (n_rows, 1));
+
+		for (k = 0; k < n_rows; k++) {
+			tail[k] = rows[k] + x;
+		}
+		filter_column_scalar (tail, weights, n_rows, dest + x, width - x);
+	}
+}
+
+#endif /* HAVE_SSE2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+
+static inline int32x4_t
+accumulate_neon (int32x4_t acc,
+		 guint32 pixel,
+		 gint16 weight)
+{
+	uint8x8_t p;
+
+	p = vreinterpret_u8_u32 (vdup_n_u32 (pixel));
+	return vmlal_n_s16 (acc, vget_low_s16 (vreinterpretq_s16_u16 (vmovl_u8 (p))), weight);
+}
+
+static inline guint32
+pack_sums_neon (int32x4_t acc)
+{
+	int16x4_t v;
+
+	v = vqmovn_s32 (vrshrq_n_s32 (acc, WEIGHT_BITS));
+	v = vmax_s16 (v, vdup_n_s16 (0));
+	v = vmin_s16 (v, vdup_n_s16 (255));
+	v = vmin_s16 (v, vdup_lane_s16 (v, 3));
+
+	return vget_lane_u32 (vreinterpret_u32_u8 (vqmovun_s16 (vcombine_s16 (v, v))), 0);
+}
+
+static void
+filter_row_neon (const guint32 *src,
+		 guint32 *dest,
+		 int width,
+		 const Contribs *contribs)
+{
+	const guint32 *s;
+	const gint16 *w;
+	int32x4_t acc;
+	int x, k;
+
+	for (x = 0; x < width; x++) {
+		s = src + contribs->start[x];
+		w = contribs->weights + (gsize) x * contribs->n_taps;
+		acc = vdupq_n_s32 (0);
+
+		for (k = 0; k < contribs->count[x]; k++) {
+			acc = accumulate_neon (acc, s[k], w[k]);
+		}
+
+		dest[x] = pack_sums_neon (acc);
+	}
+}
+
+static void
+filter_column_neon (const guint32 **rows,
+		    const gint16 *weights,
+		    int n_rows,
+		    guint32 *dest,
+		    int width)
+{
+	int32x4_t acc;
+	int x, k;
+
+	for (x = 0; x < width; x++) {
+		acc = vdupq_n_s32 (0);
+
+		for (k = 0; k < n_rows; k++) {
+			acc = accumulate_neon (acc, rows[k][x], weights[k]);
+		}
+
+		dest[x] = pack_sums_neon (acc);
+	}
+}
+
+#endif /* HAVE_NEON_KERNELS */
+
+/* The SIMD kernels assume little-endian byte order, alpha last */
+static void
+init_kernels (void)
+{
+	filter_row = filter_row_scalar;
+	filter_column = filter_column_scalar;
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#ifdef HAVE_SSE2_KERNELS
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("sse2")) {
+		filter_row = filter_row_sse2;
+		filter_column = filter_column_sse2;
+	}
+#endif
+#ifdef HAVE_NEON_KERNELS
+	filter_row = filter_row_neon;
+	filter_column = filter_column_neon;
+#endif
+#endif
+}
+
+/* Filters rows of the input horizontally, only those the band
+ * needs, then the band vertically out of them.
+ */
+static void
+scale_band (ScaleJob *job,
+	    int y0,
+	    int y1)
+{
+	const guint32 **rows;
+	guint32 *tmp;
+	int y, k, first, last, n_rows;
+
+	first = job->y->start[y0];
+	last = first;
+	for (y = y0; y < y1; y++) {
+		last = MAX (last, job->y->start[y] + job->y->count[y] - 1);
+	}
+	n_rows = last - first + 1;
+
+	tmp = g_new (guint32, (gsize) n_rows * job->dest_width);
+	for (k = 0; k < n_rows; k++) {
+		filter_row ((const guint32 *) (job->src + (gsize) (first + k) * job->src_stride),
+			    tmp + (gsize) k * job->dest_width,
+			    job->dest_width, job->x);
+	}
+
+	rows = g_new (const guint32 *, job->y->n_taps);
+	for (y = y0; y < y1; y++) {
+		for (k = 0; k < job->y->count[y]; k++) {
+			rows[k] = tmp + (gsize) (job->y->start[y] - first + k) * job->dest_width;
+		}
+		filter_column (rows,
+			       job->y->weights + (gsize) y * job->y->n_taps,
+			       job->y->count[y],
+			       (guint32 *) (job->dest + (gsize) y * job->dest_stride),
+			       job->dest_width);
+	}
+
+	g_free (rows);
+	g_free (tmp);
+}
+
+static void
+band_func (gpointer data,
+	   gpointer user_data)
+{
+	Band *band = data;
+	ScaleJob *job = band->job;
+
+	scale_band (job, band->y0, band->y1);
+	g_slice_free (Band, band);
+
+	g_mutex_lock (&job->lock);
+	if (--job->pending == 0) {
+		g_cond_signal (&job->cond);
+	}
+	g_mutex_unlock (&job->lock);
+}
+
+static gpointer
+init_pool (gpointer data)
+{
+	init_kernels ();
+
+	return g_thread_pool_new (band_func, NULL,
+				  g_get_num_processors (), FALSE, NULL);
+}
+
+void
+nautilus_background_scale (cairo_surface_t *src,
+			   cairo_surface_t *dest,
+			   double offset_x,
+			   double offset_y,
+			   double scale_x,
+			   double scale_y,
+			   NautilusBackgroundFilter filter)
+{
+	static GOnce pool_once = G_ONCE_INIT;
+	ScaleJob job;
+	Band *band;
+	int i, n_bands, dest_height, y0, y1;
+
+	g_return_if_fail (cairo_surface_get_type (src) == CAIRO_SURFACE_TYPE_IMAGE);
+	g_return_if_fail (cairo_surface_get_type (dest) == CAIRO_SURFACE_TYPE_IMAGE);
+	g_return_if_fail (scale_x > 0.0 && scale_y > 0.0);
+
+	pool = g_once (&pool_once, init_pool, NULL);
+
+	cairo_surface_flush (src);
+	cairo_surface_flush (dest);
+
+	job.src = cairo_image_surface_get_data (src);
+	job.src_stride = cairo_image_surface_get_stride (src);
+	job.dest = cairo_image_surface_get_data (dest);
+	job.dest_width = cairo_image_surface_get_width (dest);
+	job.dest_stride = cairo_image_surface_get_stride (dest);
+	dest_height = cairo_image_surface_get_height (dest);
+
+	if (job.dest_width <= 0 || dest_height <= 0 ||
+	    cairo_image_surface_get_width (src) <= 0 ||
+	    cairo_image_surface_get_height (src) <= 0) {
+		return;
+	}
+
+	job.x = contribs_new (cairo_image_surface_get_width (src), job.dest_width,
+			      offset_x, scale_x, filter);
+	job.y = contribs_new (cairo_image_surface_get_height (src), dest_height,
+			      offset_y, scale_y, filter);
+
+	n_bands = CLAMP (dest_height / MIN_BAND_HEIGHT, 1, (int) g_get_num_processors ());
+
+	g_mutex_init (&job.lock);
+	g_cond_init (&job.cond);
+	job.pending = n_bands - 1;
+
+	/* The first band is done here, the others on the pool */
+	for (i = 1; i < n_bands; i++) {
+		band = g_slice_new (Band);
+		band->job = &job;
+		band->y0 = (gint64) dest_height * i / n_bands;
+		band->y1 = (gint64) dest_height * (i + 1) / n_bands;
+		g_thread_pool_push (pool, band, NULL);
+	}
+
+	y0 = 0;
+	y1 = dest_height / n_bands;
+	scale_band (&job, y0, y1);
+
+	g_mutex_lock (&job.lock);
+	while (job.pending > 0) {
+		g_cond_wait (&job.cond, &job.lock);
+	}
+	g_mutex_unlock (&job.lock);
+
+	g_mutex_clear (&job.lock);
+	g_cond_clear (&job.cond);
+
+	contribs_free (job.x);
+	contribs_free (job.y);
+
+	cairo_surface_mark_dirty (dest);
+}
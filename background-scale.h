@@ -0,0 +1,51 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-scale.h: Multi-threaded image scaling for placed pictures.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#ifndef __NAUTILUS_BACKGROUND_SCALE_H__
+#define __NAUTILUS_BACKGROUND_SCALE_H__
+
+#include <gtk/gtk.h>
+
+typedef enum {
+	NAUTILUS_BACKGROUND_FILTER_BILINEAR,
+	NAUTILUS_BACKGROUND_FILTER_LANCZOS
+} NautilusBackgroundFilter;
+
+/* Fills @dest from @src, where pixel (x, y) of @src lands on
+ * (x * @scale_x + @offset_x, y * @scale_y + @offset_y) of @dest. Both
+ * are ARGB32 or RGB24 image surfaces. When shrinking, the filter is
+ * widened so that every source pixel counts. The output is split into
+ * bands that are filtered in parallel; returns when all are done.
+ */
+void nautilus_background_scale (cairo_surface_t          *src,
+				cairo_surface_t          *dest,
+				double                    offset_x,
+				double                    offset_y,
+				double                    scale_x,
+				double                    scale_y,
+				NautilusBackgroundFilter  filter);
+
+#endif /* __NAUTILUS_BACKGROUND_SCALE_H__ */
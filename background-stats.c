@@ -0,0 +1,228 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-stats.c: Timing histograms and counters.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#include "background-stats.h"
+
+#include <glib-unix.h>
+#include <signal.h>
+
+/* Bucket i holds spans of less than 2^i microseconds; the last one
+ * everything from about a minute up.
+ */
+#define N_BUCKETS 27
+
+typedef struct {
+	guint64 count;
+	guint64 total;
+	guint64 max;
+	guint64 buckets[N_BUCKETS];
+} Histogram;
+
+static const char * const span_names[NAUTILUS_BACKGROUND_N_SPANS] = {
+	"settings-load",
+	"decode",
+	"scale",
+	"render",
+	"upload",
+	"set-root",
+	"fade-start",
+	"fade-frame",
+	"animation-decode",
+	"animation-frame",
+};
+
+static const char * const counter_names[NAUTILUS_BACKGROUND_N_COUNTERS] = {
+	"merged-events",
+	"bytes-sent",
+	"renders",
+	"cache-hits",
+	"previews",
+	"adopted",
+	"wakeups",
+	"repaints",
+	"suspended-events",
+	"fades-stepped",
+	"fades-skipped",
+	"remote-updates-avoided",
+	"memory-releases",
+	"animation-frames",
+	"animation-late-frames",
+};
+
+static GMutex stats_lock;
+static Histogram histograms[NAUTILUS_BACKGROUND_N_SPANS];
+static guint64 counters[NAUTILUS_BACKGROUND_N_COUNTERS];
+
+gint64
+nautilus_background_stats_begin (void)
+{
+	return g_get_monotonic_time ();
+}
+
+void
+nautilus_background_stats_end (NautilusBackgroundSpan span,
+			       gint64 start)
+{
+	Histogram *histogram;
+	guint64 elapsed;
+	int bucket;
+
+	g_return_if_fail (span < NAUTILUS_BACKGROUND_N_SPANS);
+
+	elapsed = MAX (g_get_monotonic_time () - start, 0);
+	bucket = (elapsed == 0) ? 0 : g_bit_storage (elapsed);
+	bucket = MIN (bucket, N_BUCKETS - 1);
+
+	g_mutex_lock (&stats_lock);
+	histogram = &histograms[span];
+	histogram->count++;
+	histogram->total += elapsed;
+	histogram->max = MAX (histogram->max, elapsed);
+	histogram->buckets[bucket]++;
+	g_mutex_unlock (&stats_lock);
+}
+
+void
+nautilus_background_stats_add (NautilusBackgroundCounter counter,
+			       guint64 amount)
+{
+	g_return_if_fail (counter < NAUTILUS_BACKGROUND_N_COUNTERS);
+
+	g_mutex_lock (&stats_lock);
+	counters[counter] += amount;
+	g_mutex_unlock (&stats_lock);
+}
+
+guint64
+nautilus_background_stats_get (NautilusBackgroundCounter counter)
+{
+	guint64 value;
+
+	g_return_val_if_fail (counter < NAUTILUS_BACKGROUND_N_COUNTERS, 0);
+
+	g_mutex_lock (&stats_lock);
+	value = counters[counter];
+	g_mutex_unlock (&stats_lock);
+
+	return value;
+}
+
+/* How many times the span has been timed */
+guint64
+nautilus_background_stats_get_count (NautilusBackgroundSpan span)
+{
+	guint64 count;
+
+	g_return_val_if_fail (span < NAUTILUS_BACKGROUND_N_SPANS, 0);
+
+	g_mutex_lock (&stats_lock);
+	count = histograms[span].count;
+	g_mutex_unlock (&stats_lock);
+
+	return count;
+}
+
+/* Upper bound of the bucket the given fraction of spans falls in */
+static guint64
+get_percentile (const Histogram *histogram,
+		double fraction)
+{
+	guint64 seen = 0;
+	int i;
+
+	for (i = 0; i < N_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen > 0 && seen >= fraction * histogram->count) {
+			return MIN ((guint64) 1 << i, histogram->max);
+		}
+	}
+
+	return histogram->max;
+}
+
+char *
+nautilus_background_stats_to_string (void)
+{
+	const Histogram *histogram;
+	GString *string;
+	int i, j;
+
+	string = g_string_new (NULL);
+
+	g_mutex_lock (&stats_lock);
+
+	for (i = 0; i < NAUTILUS_BACKGROUND_N_SPANS; i++) {
+		histogram = &histograms[i];
+		g_string_append_printf (string,
+					"span=%s count=%" G_GUINT64_FORMAT
+					" total_us=%" G_GUINT64_FORMAT
+					" max_us=%" G_GUINT64_FORMAT
+					" p50_us=%" G_GUINT64_FORMAT
+					" p99_us=%" G_GUINT64_FORMAT
+					" buckets=",
+					span_names[i],
+					histogram->count,
+					histogram->total,
+					histogram->max,
+					get_percentile (histogram, 0.5),
+					get_percentile (histogram, 0.99));
+		/* Upper bound in microseconds : count */
+		for (j = 0; j < N_BUCKETS; j++) {
+			if (histogram->buckets[j] > 0) {
+				g_string_append_printf (string, "%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ",",
+							(guint64) 1 << j, histogram->buckets[j]);
+			}
+		}
+		g_string_append_c (string, '\n');
+	}
+
+	for (i = 0; i < NAUTILUS_BACKGROUND_N_COUNTERS; i++) {
+		g_string_append_printf (string, "counter=%s value=%" G_GUINT64_FORMAT "\n",
+					counter_names[i], counters[i]);
+	}
+
+	g_mutex_unlock (&stats_lock);
+
+	return g_string_free (string, FALSE);
+}
+
+static gboolean
+on_sigusr1 (gpointer user_data)
+{
+	char *stats;
+
+	stats = nautilus_background_stats_to_string ();
+	g_print ("%s", stats);
+	g_free (stats);
+
+	return G_SOURCE_CONTINUE;
+}
+
+void
+nautilus_background_stats_dump_on_signal (void)
+{
+	g_unix_signal_add (SIGUSR1, on_sigusr1, NULL);
+}
@@ -0,0 +1,87 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-stats.h: Timing histograms and counters.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+
+#ifndef __NAUTILUS_BACKGROUND_STATS_H__
+#define __NAUTILUS_BACKGROUND_STATS_H__
+
+#include <glib.h>
+
+typedef enum {
+	NAUTILUS_BACKGROUND_SPAN_SETTINGS_LOAD,
+	NAUTILUS_BACKGROUND_SPAN_DECODE,
+	NAUTILUS_BACKGROUND_SPAN_SCALE,
+	NAUTILUS_BACKGROUND_SPAN_RENDER,
+	NAUTILUS_BACKGROUND_SPAN_UPLOAD,
+	NAUTILUS_BACKGROUND_SPAN_SET_ROOT,
+	NAUTILUS_BACKGROUND_SPAN_FADE_START,
+	NAUTILUS_BACKGROUND_SPAN_FADE_FRAME,
+	NAUTILUS_BACKGROUND_SPAN_ANIMATION_DECODE,
+	NAUTILUS_BACKGROUND_SPAN_ANIMATION_FRAME,
+	NAUTILUS_BACKGROUND_N_SPANS
+} NautilusBackgroundSpan;
+
+typedef enum {
+	NAUTILUS_BACKGROUND_COUNTER_MERGED_EVENTS,
+	NAUTILUS_BACKGROUND_COUNTER_BYTES_SENT,
+	NAUTILUS_BACKGROUND_COUNTER_RENDERS,
+	NAUTILUS_BACKGROUND_COUNTER_CACHE_HITS,
+	NAUTILUS_BACKGROUND_COUNTER_PREVIEWS,
+	NAUTILUS_BACKGROUND_COUNTER_ADOPTED,
+	NAUTILUS_BACKGROUND_COUNTER_WAKEUPS,
+	NAUTILUS_BACKGROUND_COUNTER_REPAINTS,
+	NAUTILUS_BACKGROUND_COUNTER_SUSPENDED_EVENTS,
+	NAUTILUS_BACKGROUND_COUNTER_FADES_STEPPED,
+	NAUTILUS_BACKGROUND_COUNTER_FADES_SKIPPED,
+	NAUTILUS_BACKGROUND_COUNTER_REMOTE_UPDATES_AVOIDED,
+	NAUTILUS_BACKGROUND_COUNTER_MEMORY_RELEASES,
+	NAUTILUS_BACKGROUND_COUNTER_ANIMATION_FRAMES,
+	NAUTILUS_BACKGROUND_COUNTER_ANIMATION_LATE_FRAMES,
+	NAUTILUS_BACKGROUND_N_COUNTERS
+} NautilusBackgroundCounter;
+
+/* Spans are timed in microseconds into power-of-two histograms:
+ *
+ *   gint64 start = nautilus_background_stats_begin ();
+ *   ...
+ *   nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_DECODE, start);
+ *
+ * Everything here is thread-safe.
+ */
+gint64  nautilus_background_stats_begin         (void);
+void    nautilus_background_stats_end           (NautilusBackgroundSpan     span,
+						 gint64                     start);
+void    nautilus_background_stats_add           (NautilusBackgroundCounter  counter,
+						 guint64                    amount);
+guint64 nautilus_background_stats_get           (NautilusBackgroundCounter  counter);
+guint64 nautilus_background_stats_get_count     (NautilusBackgroundSpan     span);
+
+/* One line per span and counter, as key=value pairs */
+char   *nautilus_background_stats_to_string     (void);
+
+/* Prints the stats to stdout whenever SIGUSR1 comes in */
+void    nautilus_background_stats_dump_on_signal (void);
+
+#endif /* __NAUTILUS_BACKGROUND_STATS_H__ */
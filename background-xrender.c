@@ -0,0 +1,125 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-xrender.c: Server-side compositing with the RENDER extension.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-xrender.h"
+
+#include <cairo-xlib.h>
+#include <gdk/gdkx.h>
+
+gboolean
+nautilus_background_xrender_is_supported (GdkDisplay *display)
+{
+	int event_base, error_base;
+
+	if (!GDK_IS_X11_DISPLAY (display)) {
+		return FALSE;
+	}
+
+	return XRenderQueryExtension (GDK_DISPLAY_XDISPLAY (display),
+				      &event_base, &error_base);
+}
+
+Picture
+nautilus_background_xrender_picture_new (cairo_surface_t *surface,
+					 int width,
+					 int height)
+{
+	Display *display;
+	XRenderPictFormat *format;
+	XTransform transform = { {
+		{ XDoubleToFixed (1), 0, 0 },
+		{ 0, XDoubleToFixed (1), 0 },
+		{ 0, 0, XDoubleToFixed (1) }
+	} };
+	Picture picture;
+	int surface_width, surface_height;
+
+	g_return_val_if_fail (cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_XLIB, None);
+
+	display = cairo_xlib_surface_get_display (surface);
+	format = XRenderFindVisualFormat (display,
+					  cairo_xlib_surface_get_visual (surface));
+	if (format == NULL) {
+		return None;
+	}
+
+	cairo_surface_flush (surface);
+	picture = XRenderCreatePicture (display,
+					cairo_xlib_surface_get_drawable (surface),
+					format, 0, NULL);
+
+	surface_width = cairo_xlib_surface_get_width (surface);
+	surface_height = cairo_xlib_surface_get_height (surface);
+
+	/* The transform maps destination to source coordinates */
+	if (surface_width != width || surface_height != height) {
+		transform.matrix[0][0] = XDoubleToFixed ((double) surface_width / width);
+		transform.matrix[1][1] = XDoubleToFixed ((double) surface_height / height);
+		XRenderSetPictureTransform (display, picture, &transform);
+		XRenderSetPictureFilter (display, picture, FilterBilinear, NULL, 0);
+	}
+
+	return picture;
+}
+
+void
+nautilus_background_xrender_picture_free (cairo_surface_t *surface,
+					  Picture picture)
+{
+	if (picture != None) {
+		XRenderFreePicture (cairo_xlib_surface_get_display (surface), picture);
+	}
+}
+
+void
+nautilus_background_xrender_blend (cairo_surface_t *frame,
+				   Picture frame_picture,
+				   Picture start,
+				   Picture end,
+				   double progress)
+{
+	Display *display;
+	XRenderColor opacity = { 0, 0, 0, 0 };
+	Picture mask;
+	int width, height;
+
+	display = cairo_xlib_surface_get_display (frame);
+	width = cairo_xlib_surface_get_width (frame);
+	height = cairo_xlib_surface_get_height (frame);
+
+	opacity.alpha = CLAMP (progress, 0.0, 1.0) * 0xffff;
+
+	cairo_surface_flush (frame);
+
+	XRenderComposite (display, PictOpSrc, start, None, frame_picture,
+			  0, 0, 0, 0, 0, 0, width, height);
+
+	mask = XRenderCreateSolidFill (display, &opacity);
+	XRenderComposite (display, PictOpOver, end, mask, frame_picture,
+			  0, 0, 0, 0, 0, 0, width, height);
+	XRenderFreePicture (display, mask);
+
+	cairo_surface_mark_dirty (frame);
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-xrender.h: Server-side compositing with the RENDER extension.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_XRENDER_H__
+#define __NAUTILUS_BACKGROUND_XRENDER_H__
+
+#include <gtk/gtk.h>
+#include <X11/extensions/Xrender.h>
+
+gboolean nautilus_background_xrender_is_supported (GdkDisplay      *display);
+
+/* @surface must be an xlib surface. The picture is transformed to
+ * cover @width x @height, so a background of another size can be
+ * composited without resizing it on the client.
+ */
+Picture  nautilus_background_xrender_picture_new  (cairo_surface_t *surface,
+						   int              width,
+						   int              height);
+void     nautilus_background_xrender_picture_free (cairo_surface_t *surface,
+						   Picture          picture);
+
+/* Fills @frame with @start faded @progress of the way to @end,
+ * entirely on the server.
+ */
+void     nautilus_background_xrender_blend        (cairo_surface_t *frame,
+						   Picture          frame_picture,
+						   Picture          start,
+						   Picture          end,
+						   double           progress);
+
+#endif /* __NAUTILUS_BACKGROUND_XRENDER_H__ */
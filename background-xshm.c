@@ -0,0 +1,215 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-xshm.c: Uploads backgrounds through MIT-SHM shared memory.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#include "background-xshm.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <cairo-xlib.h>
+#include <gdk/gdkx.h>
+#include <X11/extensions/XShm.h>
+
+typedef struct {
+	GdkDisplay *display;
+	XShmSegmentInfo info;
+	int width;
+	int height;
+	int stride;
+} ShmSegment;
+
+static cairo_user_data_key_t shm_segment_key;
+
+static gboolean
+free_segment_in_main (gpointer data)
+{
+	ShmSegment *segment = data;
+
+	/* A closed display lost its server, and the attachment with it */
+	if (!gdk_display_is_closed (segment->display)) {
+		XShmDetach (GDK_DISPLAY_XDISPLAY (segment->display), &segment->info);
+	}
+	shmdt (segment->info.shmaddr);
+	g_object_unref (segment->display);
+	g_slice_free (ShmSegment, segment);
+
+	return FALSE;
+}
+
+/* The last reference to the surface can be dropped on the render
+ * thread, but only the main thread may talk to the X server.
+ */
+static void
+shm_segment_free (gpointer data)
+{
+	g_main_context_invoke (NULL, free_segment_in_main, data);
+}
+
+static gboolean
+layout_matches_cairo (GdkScreen *screen)
+{
+	GdkVisual *visual;
+	guint32 red, green, blue;
+	Display *xdisplay;
+	int byte_order;
+
+	visual = gdk_screen_get_system_visual (screen);
+	gdk_visual_get_red_pixel_details (visual, &red, NULL, NULL);
+	gdk_visual_get_green_pixel_details (visual, &green, NULL, NULL);
+	gdk_visual_get_blue_pixel_details (visual, &blue, NULL, NULL);
+
+	xdisplay = GDK_SCREEN_XDISPLAY (screen);
+	byte_order = (G_BYTE_ORDER == G_LITTLE_ENDIAN) ? LSBFirst : MSBFirst;
+
+	/* CAIRO_FORMAT_RGB24 is a native-endian 0x00RRGGBB */
+	return gdk_visual_get_depth (visual) == 24 &&
+	       red == 0xff0000 && green == 0x00ff00 && blue == 0x0000ff &&
+	       ImageByteOrder (xdisplay) == byte_order;
+}
+
+cairo_surface_t *
+nautilus_background_xshm_surface_new (GdkScreen *screen,
+				      int width,
+				      int height)
+{
+	GdkDisplay *display;
+	Display *xdisplay;
+	ShmSegment *segment;
+	cairo_surface_t *surface;
+	int error;
+
+	display = gdk_screen_get_display (screen);
+	if (!GDK_IS_X11_DISPLAY (display)) {
+		return NULL;
+	}
+
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+	if (!XShmQueryExtension (xdisplay) || !layout_matches_cairo (screen)) {
+		return NULL;
+	}
+
+	segment = g_slice_new0 (ShmSegment);
+	segment->width = width;
+	segment->height = height;
+	segment->stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width);
+
+	segment->info.shmid = shmget (IPC_PRIVATE, (gsize) segment->stride * height,
+				      IPC_CREAT | 0600);
+	if (segment->info.shmid < 0) {
+		g_slice_free (ShmSegment, segment);
+		return NULL;
+	}
+
+	segment->info.shmaddr = shmat (segment->info.shmid, NULL, 0);
+	if (segment->info.shmaddr == (char *) -1) {
+		shmctl (segment->info.shmid, IPC_RMID, NULL);
+		g_slice_free (ShmSegment, segment);
+		return NULL;
+	}
+	segment->info.readOnly = False;
+
+	/* Attaching fails asynchronously for remote servers */
+	gdk_error_trap_push ();
+	XShmAttach (xdisplay, &segment->info);
+	XSync (xdisplay, False);
+	error = gdk_error_trap_pop ();
+
+	/* Gone as soon as both of us have detached */
+	shmctl (segment->info.shmid, IPC_RMID, NULL);
+
+	if (error != 0) {
+		shmdt (segment->info.shmaddr);
+		g_slice_free (ShmSegment, segment);
+		return NULL;
+	}
+
+	segment->display = g_object_ref (display);
+
+	surface = cairo_image_surface_create_for_data ((guchar *) segment->info.shmaddr,
+						       CAIRO_FORMAT_RGB24,
+						       width, height,
+						       segment->stride);
+	cairo_surface_set_user_data (surface, &shm_segment_key,
+				     segment, shm_segment_free);
+
+	return surface;
+}
+
+gboolean
+nautilus_background_xshm_put (cairo_surface_t *image,
+			      cairo_surface_t *target)
+{
+	ShmSegment *segment;
+	Display *xdisplay;
+	Drawable drawable;
+	XImage *ximage;
+	GC gc;
+
+	segment = cairo_surface_get_user_data (image, &shm_segment_key);
+	if (segment == NULL ||
+	    cairo_surface_get_type (target) != CAIRO_SURFACE_TYPE_XLIB) {
+		return FALSE;
+	}
+
+	xdisplay = cairo_xlib_surface_get_display (target);
+	if (xdisplay != GDK_DISPLAY_XDISPLAY (segment->display)) {
+		return FALSE;
+	}
+
+	ximage = XShmCreateImage (xdisplay,
+				  cairo_xlib_surface_get_visual (target),
+				  cairo_xlib_surface_get_depth (target),
+				  ZPixmap, segment->info.shmaddr, &segment->info,
+				  segment->width, segment->height);
+	if (ximage == NULL) {
+		return FALSE;
+	}
+	if (ximage->bits_per_pixel != 32 ||
+	    ximage->bytes_per_line != segment->stride) {
+		ximage->data = NULL;
+		XDestroyImage (ximage);
+		return FALSE;
+	}
+
+	cairo_surface_flush (image);
+	cairo_surface_flush (target);
+
+	drawable = cairo_xlib_surface_get_drawable (target);
+	gc = XCreateGC (xdisplay, drawable, 0, NULL);
+	XShmPutImage (xdisplay, drawable, gc, ximage,
+		      0, 0, 0, 0, segment->width, segment->height, False);
+	XFreeGC (xdisplay, gc);
+
+	/* The server reads the segment when it gets to the request;
+	 * it must be done before the segment is reused or freed.
+	 */
+	XSync (xdisplay, False);
+
+	ximage->data = NULL;
+	XDestroyImage (ximage);
+
+	cairo_surface_mark_dirty (target);
+
+	return TRUE;
+}
@@ -0,0 +1,48 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * background-xshm.h: Uploads backgrounds through MIT-SHM shared memory.
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+#ifndef __NAUTILUS_BACKGROUND_XSHM_H__
+#define __NAUTILUS_BACKGROUND_XSHM_H__
+
+#include <gtk/gtk.h>
+
+/* An image surface whose pixels live in a shared memory segment the
+ * X server of @screen has attached. Returns NULL when the server
+ * can't do MIT-SHM, e.g. when it is on another machine, or when its
+ * pixel layout differs from cairo's. Must be called on the main
+ * thread; the surface itself may be drawn to from any thread.
+ */
+cairo_surface_t *nautilus_background_xshm_surface_new (GdkScreen       *screen,
+						       int              width,
+						       int              height);
+
+/* Copies @image into the xlib surface @target on the server side.
+ * Returns FALSE, having done nothing, if @image is not from
+ * nautilus_background_xshm_surface_new() for the same display.
+ */
+gboolean         nautilus_background_xshm_put         (cairo_surface_t *image,
+						       cairo_surface_t *target);
+
+#endif /* __NAUTILUS_BACKGROUND_XSHM_H__ */
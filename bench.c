@@ -0,0 +1,473 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+
+/*
+ * GNOME Background: Benchmarks the desktop background
+ *
+ * Copyright (C) 2014 Matija Skala <mskala@gmx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Authors: Matija Skala <mskala@gmx.com>
+ */
+
+/* Meant to run on a throwaway X server with the memory GSettings
+ * backend, see "make bench". Prints one JSON object per line.
+ */
+
+#include "desktop-background.h"
+#include "desktop-window.h"
+#include "background-stats.h"
+
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <sys/resource.h>
+
+/* Give up on anything that takes longer than this */
+#define WAIT_TIMEOUT (20 * G_USEC_PER_SEC)
+
+/* A fade is over once no frame came for this long */
+#define FADE_IDLE (200 * 1000)
+
+static const char * const placements[] = {
+	"wallpaper",
+	"centered",
+	"scaled",
+	"stretched",
+	"zoom",
+	"spanned",
+	NULL
+};
+
+static const struct {
+	const char *name;
+	int width;
+	int height;
+} images[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4k",    3840, 2160 },
+	{ "8k",    7680, 4320 },
+};
+
+static GSettings *background_settings;
+static GSettings *desktop_settings;
+static NautilusDesktopBackground *background;
+static char *image_uris[G_N_ELEMENTS (images)];
+static Atom root_pixmap_atom;
+static int resize_width;
+static int resize_height;
+
+/* What happened since the last trigger */
+static gint64 trigger_time;
+static guint64 repaints;
+static gint64 first_paint_time;
+static gint64 settled_time;
+static gboolean saw_rendering;
+static guint64 fade_frames;
+static GArray *frame_times;
+
+static GdkFilterReturn
+root_filter (GdkXEvent *gdk_xevent,
+	     GdkEvent *event,
+	     gpointer data)
+{
+	XEvent *xevent = gdk_xevent;
+
+	if (xevent->type == PropertyNotify &&
+	    xevent->xproperty.atom == root_pixmap_atom &&
+	    trigger_time != 0 && first_paint_time == 0) {
+		first_paint_time = g_get_monotonic_time ();
+	}
+
+	return GDK_FILTER_CONTINUE;
+}
+
+static void
+on_rendering_changed (GObject *object,
+		      GParamSpec *pspec,
+		      gpointer data)
+{
+	gboolean rendering;
+
+	g_object_get (object, "rendering", &rendering, NULL);
+
+	if (rendering) {
+		saw_rendering = TRUE;
+	} else if (saw_rendering && settled_time == 0) {
+		settled_time = g_get_monotonic_time ();
+	}
+}
+
+static void
+on_after_paint (GdkFrameClock *frame_clock,
+		gpointer data)
+{
+	guint64 frames;
+	gint64 now;
+
+	frames = nautilus_background_stats_get_count (NAUTILUS_BACKGROUND_SPAN_FADE_FRAME);
+	if (frames != fade_frames) {
+		fade_frames = frames;
+		now = g_get_monotonic_time ();
+		g_array_append_val (frame_times, now);
+	}
+}
+
+static void
+trigger (void)
+{
+	trigger_time = g_get_monotonic_time ();
+	first_paint_time = 0;
+	settled_time = 0;
+	saw_rendering = FALSE;
+	repaints = nautilus_background_stats_get (NAUTILUS_BACKGROUND_COUNTER_REPAINTS);
+	fade_frames = nautilus_background_stats_get_count (NAUTILUS_BACKGROUND_SPAN_FADE_FRAME);
+	g_array_set_size (frame_times, 0);
+}
+
+static gboolean
+wake_up (gpointer data)
+{
+	return G_SOURCE_CONTINUE;
+}
+
+/* Done rendering, or done without having to render at all */
+static gboolean
+is_settled (void)
+{
+	gboolean rendering;
+
+	if (settled_time == 0 && !saw_rendering &&
+	    nautilus_background_stats_get (NAUTILUS_BACKGROUND_COUNTER_REPAINTS) != repaints) {
+		g_object_get (background, "rendering", &rendering, NULL);
+		if (!rendering) {
+			settled_time = g_get_monotonic_time ();
+		}
+	}
+
+	return settled_time != 0;
+}
+
+static gboolean
+is_fade_over (void)
+{
+	gint64 last;
+
+	if (settled_time == 0) {
+		return FALSE;
+	}
+	last = (frame_times->len > 0) ?
+		g_array_index (frame_times, gint64, frame_times->len - 1) :
+		settled_time;
+
+	return g_get_monotonic_time () - last > FADE_IDLE;
+}
+
+static gboolean
+wait_for (gboolean (* done) (void))
+{
+	gint64 deadline;
+	guint id;
+
+	deadline = g_get_monotonic_time () + WAIT_TIMEOUT;
+	id = g_timeout_add (10, wake_up, NULL);
+
+	while (!done () && g_get_monotonic_time () < deadline) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_source_remove (id);
+
+	return done ();
+}
+
+static gboolean
+is_resized (void)
+{
+	GdkScreen *screen;
+
+	screen = gdk_screen_get_default ();
+
+	return gdk_screen_get_width (screen) == resize_width &&
+	       gdk_screen_get_height (screen) == resize_height;
+}
+
+/* A real resize through RandR, which GDK turns into size-changed
+ * and monitors-changed. Xvfb only shrinks below the size it started
+ * with, and RandR is off with Xinerama.
+ */
+static gboolean
+resize_screen (GdkScreen *screen,
+	       int width,
+	       int height)
+{
+	Display *xdisplay;
+	int event_base, error_base;
+
+	xdisplay = GDK_SCREEN_XDISPLAY (screen);
+	if (!XRRQueryExtension (xdisplay, &event_base, &error_base)) {
+		return FALSE;
+	}
+
+	gdk_error_trap_push ();
+	XRRSetScreenSize (xdisplay,
+			  GDK_WINDOW_XID (gdk_screen_get_root_window (screen)),
+			  width, height,
+			  gdk_screen_get_width_mm (screen) * width / gdk_screen_get_width (screen),
+			  gdk_screen_get_height_mm (screen) * height / gdk_screen_get_height (screen));
+	if (gdk_error_trap_pop () != 0) {
+		return FALSE;
+	}
+
+	resize_width = width;
+	resize_height = height;
+
+	return wait_for (is_resized);
+}
+
+/* Milliseconds since the trigger, or null if it never happened */
+static void
+append_ms (GString *json,
+	   const char *key,
+	   gint64 time)
+{
+	if (time == 0) {
+		g_string_append_printf (json, ",\"%s\":null", key);
+	} else {
+		g_string_append_printf (json, ",\"%s\":%.1f", key,
+					(time - trigger_time) / 1000.0);
+	}
+}
+
+static void
+print_result (GdkScreen *screen,
+	      const char *event,
+	      const char *image,
+	      const char *placement,
+	      GString *extra)
+{
+	struct rusage usage;
+	GString *json;
+
+	getrusage (RUSAGE_SELF, &usage);
+
+	json = g_string_new (NULL);
+	g_string_append_printf (json, "{\"screen\":\"%dx%d\",\"monitors\":%d,\"event\":\"%s\"",
+				gdk_screen_get_width (screen),
+				gdk_screen_get_height (screen),
+				gdk_screen_get_n_monitors (screen),
+				event);
+	g_string_append_printf (json, ",\"image\":\"%s\",\"placement\":\"%s\"", image, placement);
+	append_ms (json, "first_paint_ms", first_paint_time);
+	append_ms (json, "settled_ms", settled_time);
+	if (extra != NULL) {
+		g_string_append (json, extra->str);
+	}
+	/* Peak over the whole run so far, as getrusage() has it */
+	g_string_append_printf (json, ",\"peak_rss_kb\":%ld}", usage.ru_maxrss);
+
+	g_print ("%s\n", json->str);
+	g_string_free (json, TRUE);
+}
+
+/* Frames per second over the fade, and how far frame intervals
+ * stray from their mean.
+ */
+static GString *
+get_fade_results (void)
+{
+	GString *extra;
+	double interval, mean, variance, span;
+	guint i, n;
+
+	extra = g_string_new (NULL);
+	n = frame_times->len;
+
+	g_string_append_printf (extra, ",\"fade_frames\":%u", n);
+	if (n < 2) {
+		g_string_append (extra, ",\"fade_fps\":null,\"fade_jitter_ms\":null");
+		return extra;
+	}
+
+	span = g_array_index (frame_times, gint64, n - 1) - g_array_index (frame_times, gint64, 0);
+	mean = span / (n - 1);
+	variance = 0;
+	for (i = 1; i < n; i++) {
+		interval = g_array_index (frame_times, gint64, i) - g_array_index (frame_times, gint64, i - 1);
+		variance += (interval - mean) * (interval - mean);
+	}
+	variance /= n - 1;
+
+	g_string_append_printf (extra, ",\"fade_fps\":%.1f,\"fade_jitter_ms\":%.2f",
+				(n - 1) * (double) G_USEC_PER_SEC / span,
+				sqrt (variance) / 1000.0);
+
+	return extra;
+}
+
+static char *
+create_image (const char *dir,
+	      const char *name,
+	      int width,
+	      int height)
+{
+	GdkPixbuf *pixbuf;
+	guchar *pixels, *p;
+	char *basename, *path, *uri;
+	int x, y, stride;
+	guint32 seed = 1;
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	stride = gdk_pixbuf_get_rowstride (pixbuf);
+
+	/* Gradients with some noise, so the encoder has real work to do */
+	for (y = 0; y < height; y++) {
+		p = pixels + y * stride;
+		for (x = 0; x < width; x++) {
+			seed = seed * 1103515245 + 12345;
+			p[0] = x * 255 / width ^ ((seed >> 16) & 0x0f);
+			p[1] = y * 255 / height ^ ((seed >> 20) & 0x0f);
+			p[2] = (x + y) * 255 / (width + height);
+			p += 3;
+		}
+	}
+
+	basename = g_strconcat (name, ".jpg", NULL);
+	path = g_build_filename (dir, basename, NULL);
+	gdk_pixbuf_save (pixbuf, path, "jpeg", NULL, "quality", "90", NULL);
+	uri = g_filename_to_uri (path, NULL, NULL);
+
+	g_object_unref (pixbuf);
+	g_free (path);
+	g_free (basename);
+
+	return uri;
+}
+
+static void
+set_background (const char *uri,
+		const char *placement)
+{
+	g_settings_delay (background_settings);
+	g_settings_set_string (background_settings, "picture-uri", uri);
+	g_settings_set_string (background_settings, "picture-options", placement);
+	g_settings_apply (background_settings);
+}
+
+int
+main (int argc, char **argv)
+{
+	GdkScreen *screen;
+	GtkWidget *desktop;
+	GdkWindow *root;
+	GString *extra;
+	char *dir;
+	gboolean can_resize;
+	int width, height;
+	guint i, j;
+
+	gtk_init (&argc, &argv);
+
+	screen = gdk_screen_get_default ();
+	root = gdk_screen_get_root_window (screen);
+	root_pixmap_atom = gdk_x11_get_xatom_by_name ("_XROOTPMAP_ID");
+	gdk_window_set_events (root, gdk_window_get_events (root) | GDK_PROPERTY_CHANGE_MASK);
+	gdk_window_add_filter (root, root_filter, NULL);
+
+	frame_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+	dir = g_dir_make_tmp ("background-bench-XXXXXX", NULL);
+	for (i = 0; i < G_N_ELEMENTS (images); i++) {
+		image_uris[i] = create_image (dir, images[i].name,
+					      images[i].width, images[i].height);
+	}
+
+	background_settings = g_settings_new ("org.gnome.desktop.background");
+	desktop_settings = g_settings_new ("org.gnome.nautilus.desktop");
+	g_settings_set_boolean (desktop_settings, "background-fade", FALSE);
+	set_background (image_uris[0], "zoom");
+
+	/* Time to first paint from a cold start */
+	trigger ();
+	desktop = nautilus_desktop_window_new (screen);
+	background = nautilus_desktop_background_new (desktop);
+	g_signal_connect (background, "notify::rendering",
+			  G_CALLBACK (on_rendering_changed), NULL);
+	gtk_widget_show (desktop);
+	wait_for (is_settled);
+	print_result (screen, "startup", images[0].name, "zoom", NULL);
+
+	g_signal_connect (gtk_widget_get_frame_clock (desktop), "after-paint",
+			  G_CALLBACK (on_after_paint), NULL);
+
+	width = gdk_screen_get_width (screen);
+	height = gdk_screen_get_height (screen);
+	can_resize = TRUE;
+
+	for (i = 0; i < G_N_ELEMENTS (images); i++) {
+		for (j = 0; placements[j] != NULL; j++) {
+			trigger ();
+			set_background (image_uris[i], placements[j]);
+			wait_for (is_settled);
+			print_result (screen, "settings-changed", images[i].name, placements[j], NULL);
+
+			/* To three quarters of the size and back; the
+			 * screen in each result is the size changed to
+			 */
+			if (can_resize) {
+				trigger ();
+				can_resize = resize_screen (screen, (width * 3 / 4) & ~7, (height * 3 / 4) & ~7);
+				if (!can_resize) {
+					g_printerr ("The X server can't resize the screen, skipping size changes\n");
+				}
+			}
+			if (can_resize) {
+				wait_for (is_settled);
+				print_result (screen, "size-changed", images[i].name, placements[j], NULL);
+
+				trigger ();
+				resize_screen (screen, width, height);
+				wait_for (is_settled);
+				print_result (screen, "size-changed", images[i].name, placements[j], NULL);
+			}
+		}
+
+		/* Fade to the next picture */
+		g_settings_set_boolean (desktop_settings, "background-fade", TRUE);
+		trigger ();
+		set_background (image_uris[(i + 1) % G_N_ELEMENTS (images)], "zoom");
+		wait_for (is_fade_over);
+		extra = get_fade_results ();
+		print_result (screen, "crossfade",
+			      images[(i + 1) % G_N_ELEMENTS (images)].name, "zoom", extra);
+		g_string_free (extra, TRUE);
+		g_settings_set_boolean (desktop_settings, "background-fade", FALSE);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (images); i++) {
+		char *path = g_filename_from_uri (image_uris[i], NULL, NULL);
+		g_unlink (path);
+		g_free (path);
+		g_free (image_uris[i]);
+	}
+	g_rmdir (dir);
+	g_free (dir);
+
+	return 0;
+}
@@ -28,45 +28,147 @@
 
 #include "desktop-background.h"
 #include "desktop-window.h"
+#include "background-activity.h"
+#include "background-animation.h"
+#include "background-crossfade.h"
+#include "background-pressure.h"
+#include "background-render.h"
+#include "background-root.h"
+#include "background-stats.h"
+#include "background-xshm.h"
 
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 #include <libgnome-desktop/gnome-bg.h>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #define NAUTILUS_PREFERENCES_DESKTOP_BACKGROUND_FADE       "background-fade"
 
+/* Previews are rendered this many times smaller than the screen */
+#define PREVIEW_DIVISOR 8
+
+/* How long to wait for more change events before acting on them */
+#define DEFAULT_DEBOUNCE_INTERVAL 50
+
+/* Remote displays repaint once slideshow transitions have gone
+ * quiet for this long, in milliseconds
+ */
+#define REMOTE_TRANSITION_SETTLE 2000
+
+typedef enum {
+	CHANGE_RELOAD_SETTINGS = 1 << 0,
+	/* What the background shows changed */
+	CHANGE_RENDER          = 1 << 1,
+	/* Only the screen changed, the same background needs redoing */
+	CHANGE_GEOMETRY        = 1 << 2,
+} ChangeFlags;
+
 GSettings *nautilus_desktop_preferences;
 GSettings *gnome_background_preferences;
 
 static void init_fade (NautilusDesktopBackground *self);
 static void free_fade (NautilusDesktopBackground *self);
 static void queue_background_change (NautilusDesktopBackground *self);
+static void schedule_change (NautilusDesktopBackground *self,
+			     ChangeFlags changes);
+static void nautilus_desktop_background_set_up_widget (NautilusDesktopBackground *self);
+static void install_background (NautilusDesktopBackground *self);
+static gboolean nautilus_desktop_background_ensure_realized (NautilusDesktopBackground *self);
 
-static NautilusDesktopBackground *singleton = NULL;
+/* One background per screen, whatever display it is on */
+static GHashTable *instances = NULL;
 
 G_DEFINE_TYPE (NautilusDesktopBackground, nautilus_desktop_background, G_TYPE_OBJECT);
 
 enum {
         PROP_WIDGET = 1,
+        PROP_DEBOUNCE_INTERVAL,
+        PROP_MERGED_EVENTS,
+        PROP_USE_XRENDER,
+        PROP_BYTES_SENT,
+        PROP_LOW_MEMORY,
+        PROP_RESIDENT_BYTES,
+        PROP_RENDERING,
+        PROP_REMOTE,
         NUM_PROPERTIES,
 };
 
 struct NautilusDesktopBackgroundDetails {
 
 	GtkWidget *widget;
+	GdkScreen *screen;
         GnomeBG *bg;
 
 	/* Realized data: */
 	cairo_surface_t *background_surface;
-	GnomeBGCrossfade *fade;
+	NautilusBackgroundCrossfade *fade;
+	/* Plays over the still picture when that is animated, and was
+	 * started for the background and geometry serials below
+	 */
+	NautilusBackgroundAnimation *animation;
+	guint animation_serial;
+	guint animation_geometry;
+	gboolean use_xrender;
+	gboolean low_memory;
+	/* Every changed pixel goes over the network: no crossfades or
+	 * previews, few colours, slideshow transitions skipped
+	 */
+	gboolean remote;
+	/* A crossfade was called off for being remote, and is counted
+	 * when the background it was for goes up
+	 */
+	gboolean fade_avoided;
+	guint transition_settle_id;
+	/* The background is a plain colour, which the window shows
+	 * without a surface
+	 */
+	gboolean is_solid;
+	GdkRGBA solid_color;
+	/* Render key of background_surface, NULL if it has none */
+	char *background_key;
 	int background_entire_width;
 	int background_entire_height;
 	GdkColor default_color;
 
+	/* Bumped on every CHANGE_RENDER and CHANGE_GEOMETRY. The
+	 * installed surface and the render in flight each remember
+	 * the ones they were made for.
+	 */
+	guint content_serial;
+	guint geometry_serial;
+	guint background_serial;
+	guint background_geometry;
+	guint render_serial;
+	guint render_geometry;
+
+	/* Render job in flight, if any */
+	GCancellable *render_cancellable;
+	int render_width;
+	int render_height;
+	char *render_key;
+	/* Quick preview of the same, if one is on its way */
+	GCancellable *preview_cancellable;
+
 	/* Desktop screen size watcher */
 	gulong screen_size_handler;
 	/* Desktop monitors configuration watcher */
 	gulong screen_monitors_handler;
+
+	/* Change events waiting for the debounce window to close */
 	guint change_idle_id;
+	ChangeFlags pending_changes;
+	guint debounce_interval;
+	guint merged_events;
+
+	/* Nobody can see the desktop; changes wait in suspended_changes */
+	NautilusBackgroundActivity *activity;
+	ChangeFlags suspended_changes;
+
+	/* Memory is being given back: a fade that ends meanwhile
+	 * must not start renders or animations again
+	 */
+	gboolean releasing_memory;
 };
 
 
@@ -86,6 +188,27 @@ free_fade (NautilusDesktopBackground *self)
 	}
 }
 
+static void
+cancel_preview (NautilusDesktopBackground *self)
+{
+	if (self->details->preview_cancellable != NULL) {
+		g_cancellable_cancel (self->details->preview_cancellable);
+		g_clear_object (&self->details->preview_cancellable);
+	}
+}
+
+static void
+cancel_render (NautilusDesktopBackground *self)
+{
+	cancel_preview (self);
+
+	if (self->details->render_cancellable != NULL) {
+		g_cancellable_cancel (self->details->render_cancellable);
+		g_clear_object (&self->details->render_cancellable);
+	}
+	g_clear_pointer (&self->details->render_key, g_free);
+}
+
 static void
 free_background_surface (NautilusDesktopBackground *self)
 {
@@ -96,6 +219,8 @@ free_background_surface (NautilusDesktopBackground *self)
 		cairo_surface_destroy (surface);
 		self->details->background_surface = NULL;
 	}
+	self->details->is_solid = FALSE;
+	g_clear_pointer (&self->details->background_key, g_free);
 }
 
 static void
@@ -109,24 +234,53 @@ nautilus_desktop_background_finalize (GObject *object)
 					      background_settings_change_event_cb,
 					      self);
 
+	if (self->details->change_idle_id != 0) {
+		g_source_remove (self->details->change_idle_id);
+		self->details->change_idle_id = 0;
+	}
+
+	if (self->details->transition_settle_id != 0) {
+		g_source_remove (self->details->transition_settle_id);
+		self->details->transition_settle_id = 0;
+	}
+
+	cancel_render (self);
 	free_background_surface (self);
 	free_fade (self);
+	g_clear_object (&self->details->animation);
 
+	if (self->details->activity != NULL) {
+		g_signal_handlers_disconnect_by_data (self->details->activity, self);
+		g_clear_object (&self->details->activity);
+	}
+	g_signal_handlers_disconnect_by_data (nautilus_background_pressure_get_default (), self);
 	g_clear_object (&self->details->bg);
 
+	g_hash_table_remove (instances, self->details->screen);
+	nautilus_background_render_forget_screen (self->details->screen);
+	g_clear_object (&self->details->screen);
+
 	G_OBJECT_CLASS (nautilus_desktop_background_parent_class)->finalize (object);
 }
 
+/* Swaps in the next background in one step: the old one stays
+ * installed until its replacement is on the server. @width and
+ * @height say which screen size @surface is final for, 0 if it
+ * isn't final at all. Takes ownership of @surface and @key.
+ */
 static void
-nautilus_desktop_background_unrealize (NautilusDesktopBackground *self)
+replace_background_surface (NautilusDesktopBackground *self,
+			    cairo_surface_t *surface,
+			    char *key,
+			    int width,
+			    int height)
 {
 	free_background_surface (self);
 
-	self->details->background_entire_width = 0;
-	self->details->background_entire_height = 0;
-	self->details->default_color.red = 0xffff;
-	self->details->default_color.green = 0xffff;
-	self->details->default_color.blue = 0xffff;
+	self->details->background_surface = surface;
+	self->details->background_key = key;
+	self->details->background_entire_width = width;
+	self->details->background_entire_height = height;
 }
 
 static void
@@ -147,6 +301,13 @@ nautilus_desktop_background_set_image_uri (NautilusDesktopBackground *self,
 	g_free (filename);
 }
 
+static gboolean
+is_suspended (NautilusDesktopBackground *self)
+{
+	return self->details->activity != NULL &&
+	       nautilus_background_activity_is_suspended (self->details->activity);
+}
+
 static void
 init_fade (NautilusDesktopBackground *self)
 {
@@ -158,6 +319,10 @@ init_fade (NautilusDesktopBackground *self)
 	if (widget == NULL || !gtk_widget_get_realized (widget))
 		return;
 
+	/* Nobody would see it */
+	if (is_suspended (self))
+		return;
+
 	do_fade = g_settings_get_boolean (nautilus_desktop_preferences,
 					  NAUTILUS_PREFERENCES_DESKTOP_BACKGROUND_FADE);
 
@@ -165,13 +330,19 @@ init_fade (NautilusDesktopBackground *self)
 		return;
 	}
 
+	if (self->details->remote) {
+		self->details->fade_avoided = TRUE;
+		return;
+	}
+
 	if (self->details->fade == NULL) {
 		GdkWindow *window;
 		GdkScreen *screen;
 		int old_width, old_height, width, height;
 
 		/* If this was the result of a screen size change,
-		 * we don't want to crossfade
+		 * we don't want to crossfade, unless XRender can scale
+		 * the old background on the server
 		 */
 		window = gtk_widget_get_window (widget);
 		old_width = gdk_window_get_width (window);
@@ -181,8 +352,13 @@ init_fade (NautilusDesktopBackground *self)
 		width = gdk_screen_get_width (screen);
 		height = gdk_screen_get_height (screen);
 
-		if (old_width == width && old_height == height) {
-			self->details->fade = gnome_bg_crossfade_new (width, height);
+		if ((old_width == width && old_height == height) ||
+		    self->details->use_xrender) {
+			self->details->fade = nautilus_background_crossfade_new (width, height);
+			nautilus_background_crossfade_set_use_xrender (self->details->fade,
+								       self->details->use_xrender);
+			nautilus_background_crossfade_set_low_memory (self->details->fade,
+								      self->details->low_memory);
 			g_signal_connect_swapped (self->details->fade,
                                                   "finished",
                                                   G_CALLBACK (free_fade),
@@ -190,7 +366,7 @@ init_fade (NautilusDesktopBackground *self)
 		}
 	}
 
-	if (self->details->fade != NULL && !gnome_bg_crossfade_is_started (self->details->fade)) {
+	if (self->details->fade != NULL && !nautilus_background_crossfade_is_started (self->details->fade)) {
 		cairo_surface_t *start_surface;
 
 		if (self->details->background_surface == NULL) {
@@ -198,7 +374,7 @@ init_fade (NautilusDesktopBackground *self)
 		} else {
 			start_surface = cairo_surface_reference (self->details->background_surface);
 		}
-		gnome_bg_crossfade_set_start_surface (self->details->fade,
+		nautilus_background_crossfade_set_start_surface (self->details->fade,
 						      start_surface);
                 cairo_surface_destroy (start_surface);
 	}
@@ -208,57 +384,527 @@ static void
 screen_size_changed (GdkScreen *screen,
                      NautilusDesktopBackground *self)
 {
-	queue_background_change (self);
+	schedule_change (self, CHANGE_GEOMETRY);
+}
+
+/* What the session costs in memory, as the kernel sees it */
+static guint64
+get_resident_bytes (void)
+{
+	char *contents;
+	guint64 pages = 0;
+
+	if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+		if (sscanf (contents, "%*u %" G_GUINT64_FORMAT, &pages) != 1) {
+			pages = 0;
+		}
+		g_free (contents);
+	}
+
+	return pages * sysconf (_SC_PAGESIZE);
+}
+
+static void
+render_done_cb (GObject *source_object,
+		GAsyncResult *result,
+		gpointer user_data)
+{
+	NautilusDesktopBackground *self = user_data;
+	cairo_surface_t *image, *surface;
+	GdkScreen *screen;
+	GError *error = NULL;
+
+	image = nautilus_background_render_job_finish (result, &error);
+	if (image == NULL) {
+		/* A newer job has taken over, it will finish the work */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_warning ("Could not render desktop background: %s",
+				   error->message);
+			g_clear_object (&self->details->render_cancellable);
+			g_clear_pointer (&self->details->render_key, g_free);
+			g_object_notify (G_OBJECT (self), "rendering");
+		}
+		g_error_free (error);
+		g_object_unref (self);
+		return;
+	}
+
+	g_clear_object (&self->details->render_cancellable);
+	cancel_preview (self);
+
+	if (self->details->widget == NULL ||
+	    !gtk_widget_get_realized (self->details->widget)) {
+		cairo_surface_destroy (image);
+		g_clear_pointer (&self->details->render_key, g_free);
+		g_object_notify (G_OBJECT (self), "rendering");
+		g_object_unref (self);
+		return;
+	}
+
+	/* The screen changed again while this was rendering. Those
+	 * changes were left for now; the next render picks them all up.
+	 */
+	screen = gtk_widget_get_screen (self->details->widget);
+	if (self->details->render_width != gdk_screen_get_width (screen) ||
+	    self->details->render_height != gdk_screen_get_height (screen)) {
+		cairo_surface_destroy (image);
+		g_clear_pointer (&self->details->render_key, g_free);
+		nautilus_desktop_background_set_up_widget (self);
+		g_object_notify (G_OBJECT (self), "rendering");
+		g_object_unref (self);
+		return;
+	}
+
+	surface = nautilus_background_render_upload (gtk_widget_get_window (self->details->widget),
+						     image,
+						     self->details->render_width,
+						     self->details->render_height);
+	cairo_surface_destroy (image);
+	if (surface == NULL) {
+		g_clear_pointer (&self->details->render_key, g_free);
+		g_object_notify (G_OBJECT (self), "rendering");
+		g_object_unref (self);
+		return;
+	}
+
+	replace_background_surface (self, surface, self->details->render_key,
+				    self->details->render_width,
+				    self->details->render_height);
+	self->details->render_key = NULL;
+	self->details->background_serial = self->details->render_serial;
+	self->details->background_geometry = self->details->render_geometry;
+
+	/* We got the surface and everything, so we don't care about a change
+	   that is pending (unless things actually change after this time) */
+	g_object_set_data (G_OBJECT (self),
+			   "ignore-pending-change", GINT_TO_POINTER (TRUE));
+
+	install_background (self);
+	/* Monitors that changed while this was rendering */
+	nautilus_desktop_background_ensure_realized (self);
+	gtk_widget_queue_draw (self->details->widget);
+
+	g_debug ("Background installed, %" G_GUINT64_FORMAT " bytes resident, %" G_GSIZE_FORMAT " of them cached pixels",
+		 get_resident_bytes (), nautilus_background_render_get_cached_bytes ());
+
+	g_object_notify (G_OBJECT (self), "rendering");
+	g_object_unref (self);
 }
 
+static void
+preview_done_cb (GObject *source_object,
+		 GAsyncResult *result,
+		 gpointer user_data)
+{
+	NautilusDesktopBackground *self = user_data;
+	cairo_surface_t *image, *surface;
+	GdkScreen *screen;
+	GError *error = NULL;
+
+	image = nautilus_background_render_job_finish (result, &error);
+	if (image == NULL) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_clear_object (&self->details->preview_cancellable);
+		}
+		g_error_free (error);
+		g_object_unref (self);
+		return;
+	}
+
+	g_clear_object (&self->details->preview_cancellable);
+
+	/* Too late: the real render is in, or was called off */
+	if (self->details->render_cancellable == NULL ||
+	    self->details->widget == NULL ||
+	    !gtk_widget_get_realized (self->details->widget)) {
+		cairo_surface_destroy (image);
+		g_object_unref (self);
+		return;
+	}
+
+	/* Made for a screen size that is gone already */
+	screen = gtk_widget_get_screen (self->details->widget);
+	if (self->details->render_width != gdk_screen_get_width (screen) ||
+	    self->details->render_height != gdk_screen_get_height (screen)) {
+		cairo_surface_destroy (image);
+		g_object_unref (self);
+		return;
+	}
+
+	surface = nautilus_background_render_upload_preview (gtk_widget_get_window (self->details->widget),
+							     image,
+							     self->details->render_width,
+							     self->details->render_height);
+	cairo_surface_destroy (image);
+
+	/* The real render replaces it, fading on from here if a
+	 * fade is running.
+	 */
+	if (surface != NULL) {
+		replace_background_surface (self, surface, NULL, 0, 0);
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_PREVIEWS, 1);
+		install_background (self);
+		gtk_widget_queue_draw (self->details->widget);
+	}
+
+	g_object_unref (self);
+}
+
+/* Backgrounds without a picture need no render at all. A solid colour
+ * is one pixel, a gradient a one pixel wide strip of it, and the X
+ * server repeats either over the root pixmap. Returns NULL when there
+ * is a picture to draw.
+ */
+static cairo_surface_t *
+create_color_strip (NautilusDesktopBackground *self,
+		    GdkScreen *screen,
+		    int width,
+		    int height)
+{
+	GDesktopBackgroundShading shading;
+	GdkColor primary, secondary;
+	cairo_surface_t *strip;
+	guchar *data;
+	guint32 *pixel;
+	double ratio;
+	int i, n_pixels, stride;
+
+	if (gnome_bg_get_filename (self->details->bg) != NULL &&
+	    gnome_bg_get_placement (self->details->bg) != G_DESKTOP_BACKGROUND_STYLE_NONE) {
+		return NULL;
+	}
+
+	gnome_bg_get_color (self->details->bg, &shading, &primary, &secondary);
+
+	switch (shading) {
+	case G_DESKTOP_BACKGROUND_SHADING_VERTICAL:
+		n_pixels = height;
+		strip = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 1, height);
+		break;
+	case G_DESKTOP_BACKGROUND_SHADING_HORIZONTAL:
+		n_pixels = width;
+		strip = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, 1);
+		break;
+	case G_DESKTOP_BACKGROUND_SHADING_SOLID:
+	default:
+		n_pixels = 1;
+		secondary = primary;
+		strip = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 1, 1);
+		break;
+	}
+
+	/* gnome-bg draws gradients on each monitor separately */
+	if (n_pixels > 1 && gdk_screen_get_n_monitors (screen) > 1) {
+		cairo_surface_destroy (strip);
+		return NULL;
+	}
+
+	if (cairo_surface_status (strip) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy (strip);
+		return NULL;
+	}
+
+	data = cairo_image_surface_get_data (strip);
+	stride = cairo_image_surface_get_stride (strip);
+
+	/* Same interpolation as gnome-bg's gradients */
+	for (i = 0; i < n_pixels; i++) {
+		ratio = (i + 0.5) / n_pixels;
+		if (shading == G_DESKTOP_BACKGROUND_SHADING_VERTICAL) {
+			pixel = (guint32 *) (data + i * stride);
+		} else {
+			pixel = (guint32 *) data + i;
+		}
+		*pixel = (((guint16) (primary.red * (1 - ratio) + secondary.red * ratio) >> 8) << 16) |
+			 (((guint16) (primary.green * (1 - ratio) + secondary.green * ratio) >> 8) << 8) |
+			 ((guint16) (primary.blue * (1 - ratio) + secondary.blue * ratio) >> 8);
+	}
+	cairo_surface_mark_dirty (strip);
+
+	if (n_pixels == 1) {
+		self->details->solid_color.red = primary.red / 65535.0;
+		self->details->solid_color.green = primary.green / 65535.0;
+		self->details->solid_color.blue = primary.blue / 65535.0;
+		self->details->solid_color.alpha = 1.0;
+	}
+
+	return strip;
+}
+
+/* Returns TRUE if the surface matches the screen. Otherwise a render
+ * is started, and nautilus_desktop_background_set_up_widget() is run
+ * again once it is done.
+ */
 static gboolean
 nautilus_desktop_background_ensure_realized (NautilusDesktopBackground *self)
 {
 	int entire_width;
 	int entire_height;
 	GdkScreen *screen;
-	GdkWindow *window;
+	NautilusBackgroundRenderJob *job;
+	cairo_surface_t *target, *strip, *surface;
+	char *key;
+	gint64 start;
+	ChangeFlags changes;
 
 	screen = gtk_widget_get_screen (self->details->widget);
 	entire_height = gdk_screen_get_height (screen);
 	entire_width = gdk_screen_get_width (screen);
 
-	/* If the window size is the same as last time, don't update */
+	/* If nothing changed since last time, don't update */
 	if (entire_width == self->details->background_entire_width &&
+	    entire_height == self->details->background_entire_height &&
+	    self->details->background_serial == self->details->content_serial &&
+	    self->details->background_geometry == self->details->geometry_serial) {
+		return TRUE;
+	}
+
+	/* Nobody would see it. Whatever is out of date is caught up
+	 * with in one go when the desktop can be seen again.
+	 */
+	if (is_suspended (self)) {
+		changes = 0;
+		if (self->details->background_serial != self->details->content_serial) {
+			changes |= CHANGE_RENDER;
+		}
+		if (self->details->background_geometry != self->details->geometry_serial ||
+		    entire_width != self->details->background_entire_width ||
+		    entire_height != self->details->background_entire_height) {
+			changes |= CHANGE_GEOMETRY;
+		}
+		self->details->suspended_changes |= changes;
+		return FALSE;
+	}
+
+	/* Already on its way. If only the screen changed since, the
+	 * render is left to finish and the next one is started from
+	 * render_done_cb(), with whatever the screen looks like then.
+	 */
+	if (self->details->render_cancellable != NULL) {
+		if (self->details->render_serial == self->details->content_serial) {
+			return FALSE;
+		}
+		cancel_render (self);
+	}
+
+	/* The current background stays installed until the next one
+	 * replaces it.
+	 */
+	strip = create_color_strip (self, screen, entire_width, entire_height);
+	if (strip != NULL) {
+		/* Gradients become a few wide bands */
+		if (self->details->remote) {
+			nautilus_background_render_posterize (strip);
+		}
+		surface = nautilus_background_render_upload (gtk_widget_get_window (self->details->widget),
+							     strip, entire_width, entire_height);
+		if (surface != NULL) {
+			replace_background_surface (self, surface, NULL, entire_width, entire_height);
+			self->details->background_serial = self->details->content_serial;
+			self->details->background_geometry = self->details->geometry_serial;
+			self->details->is_solid = cairo_image_surface_get_width (strip) == 1 &&
+						  cairo_image_surface_get_height (strip) == 1;
+		}
+		cairo_surface_destroy (strip);
+
+		return surface != NULL;
+	}
+
+	start = nautilus_background_stats_begin ();
+	job = nautilus_background_render_job_new (gnome_background_preferences, screen);
+	nautilus_background_render_job_set_posterize (job, self->details->remote);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_SETTINGS_LOAD, start);
+
+	/* A previous run may have left exactly this on the root
+	 * window, then there is nothing to do.
+	 */
+	key = nautilus_background_render_job_get_key (job);
+	surface = NULL;
+	if (key != NULL) {
+		surface = nautilus_background_root_adopt (screen, key, entire_width, entire_height);
+	}
+	if (surface != NULL) {
+		nautilus_background_render_job_free (job);
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_ADOPTED, 1);
+		free_fade (self);
+
+		replace_background_surface (self, surface, key, entire_width, entire_height);
+		self->details->background_serial = self->details->content_serial;
+		self->details->background_geometry = self->details->geometry_serial;
+
+		return TRUE;
+	}
+	self->details->render_key = key;
+	self->details->render_serial = self->details->content_serial;
+	self->details->render_geometry = self->details->geometry_serial;
+
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_RENDERS, 1);
+	nautilus_background_render_job_get_size (job,
+						 &self->details->render_width,
+						 &self->details->render_height);
+
+	/* Render straight into memory the X server can read */
+	target = NULL;
+	if (!nautilus_background_render_job_is_tiled (job)) {
+		target = nautilus_background_xshm_surface_new (screen,
+							       self->details->render_width,
+							       self->details->render_height);
+	}
+	if (target != NULL) {
+		nautilus_background_render_job_set_target (job, target);
+		cairo_surface_destroy (target);
+	}
+
+	self->details->render_cancellable = g_cancellable_new ();
+	nautilus_background_render_job_run_async (job,
+						  self->details->render_cancellable,
+						  render_done_cb,
+						  g_object_ref (self));
+	g_object_notify (G_OBJECT (self), "rendering");
+
+	/* Something to look at while the real render runs, unless
+	 * what is installed only has the monitors laid out wrong
+	 */
+	if (self->details->background_serial == self->details->content_serial &&
+	    entire_width == self->details->background_entire_width &&
 	    entire_height == self->details->background_entire_height) {
 		return FALSE;
 	}
 
-	free_background_surface (self);
+	/* It would go up only to be replaced by the real thing */
+	if (self->details->remote) {
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_REMOTE_UPDATES_AVOIDED, 1);
+		return FALSE;
+	}
 
-	window = gtk_widget_get_window (self->details->widget);
-	self->details->background_surface = gnome_bg_create_surface (self->details->bg,
-                                                                     window,
-                                                                     entire_width, entire_height,
-                                                                     TRUE);
+	job = nautilus_background_render_job_new (gnome_background_preferences, screen);
+	if (nautilus_background_render_job_set_preview (job, PREVIEW_DIVISOR)) {
+		self->details->preview_cancellable = g_cancellable_new ();
+		nautilus_background_render_job_run_async (job,
+							  self->details->preview_cancellable,
+							  preview_done_cb,
+							  g_object_ref (self));
+	} else {
+		nautilus_background_render_job_free (job);
+	}
 
-	/* We got the surface and everything, so we don't care about a change
-	   that is pending (unless things actually change after this time) */
-	g_object_set_data (G_OBJECT (self),
-			   "ignore-pending-change", GINT_TO_POINTER (TRUE));
+	return FALSE;
+}
 
-	self->details->background_entire_width = entire_width;
-	self->details->background_entire_height = entire_height;
+static void
+set_surface_as_root (NautilusDesktopBackground *self,
+		     GdkScreen *screen)
+{
+	gint64 start;
+
+	/* Adopted: it is up already, and its key with it */
+	if (nautilus_background_root_is_current (screen, self->details->background_surface)) {
+		return;
+	}
 
-	return TRUE;
+	start = nautilus_background_stats_begin ();
+	gnome_bg_set_surface_as_root (screen, self->details->background_surface);
+	nautilus_background_render_set_root (self->details->background_surface);
+	nautilus_background_root_set_key (screen,
+					  self->details->background_surface,
+					  self->details->background_key);
+	nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_SET_ROOT, start);
 }
 
+/* Animated pictures play on the desktop window only. The root window
+ * keeps the still render, the first frame, for everybody else.
+ */
 static void
-on_fade_finished (GnomeBGCrossfade *fade,
+update_animation (NautilusDesktopBackground *self)
+{
+	GDesktopBackgroundShading shading;
+	GDesktopBackgroundStyle placement;
+	GdkColor primary, secondary;
+	const char *filename;
+
+	if (self->details->animation != NULL &&
+	    self->details->animation_serial == self->details->background_serial &&
+	    self->details->animation_geometry == self->details->background_geometry) {
+		return;
+	}
+	g_clear_object (&self->details->animation);
+
+	/* Previews wait for the real thing, remote displays would
+	 * get a full-screen update for every frame, and low memory
+	 * has no room for frames decoded ahead
+	 */
+	filename = gnome_bg_get_filename (self->details->bg);
+	placement = gnome_bg_get_placement (self->details->bg);
+	if (self->details->background_entire_width == 0 ||
+	    self->details->remote ||
+	    self->details->low_memory ||
+	    placement == G_DESKTOP_BACKGROUND_STYLE_NONE ||
+	    !nautilus_background_animation_can_animate (filename)) {
+		return;
+	}
+
+	gnome_bg_get_color (self->details->bg, &shading, &primary, &secondary);
+	self->details->animation =
+		nautilus_background_animation_new (gtk_widget_get_window (self->details->widget),
+						   filename, placement, &primary,
+						   NAUTILUS_BACKGROUND_ANIMATION_DEFAULT_BUDGET);
+	self->details->animation_serial = self->details->background_serial;
+	self->details->animation_geometry = self->details->background_geometry;
+
+	if (self->details->animation != NULL && is_suspended (self)) {
+		nautilus_background_animation_set_paused (self->details->animation, TRUE);
+	}
+}
+
+/* Puts the still picture back up */
+static void
+stop_animation (NautilusDesktopBackground *self)
+{
+	cairo_pattern_t *pattern;
+
+	if (self->details->animation == NULL) {
+		return;
+	}
+	g_clear_object (&self->details->animation);
+
+	if (self->details->widget != NULL &&
+	    gtk_widget_get_realized (self->details->widget) &&
+	    self->details->background_surface != NULL &&
+	    !self->details->is_solid) {
+		pattern = cairo_pattern_create_for_surface (self->details->background_surface);
+		gdk_window_set_background_pattern (gtk_widget_get_window (self->details->widget),
+						   pattern);
+		cairo_pattern_destroy (pattern);
+		gtk_widget_queue_draw (self->details->widget);
+	}
+}
+
+static void
+on_fade_finished (NautilusBackgroundCrossfade *fade,
 		  GdkWindow *window,
 		  gpointer user_data)
 {
         NautilusDesktopBackground *self = user_data;
 
-	nautilus_desktop_background_ensure_realized (self);
-	if (self->details->background_surface != NULL)
-		gnome_bg_set_surface_as_root (gdk_window_get_screen (window),
-					      self->details->background_surface);
+	/* Only what is there already goes up */
+	if (self->details->releasing_memory) {
+		if (self->details->background_surface != NULL) {
+			if (self->details->is_solid) {
+				gdk_window_set_background_rgba (window, &self->details->solid_color);
+			}
+			set_surface_as_root (self, gdk_window_get_screen (window));
+		}
+		return;
+	}
+
+	if (nautilus_desktop_background_ensure_realized (self) &&
+	    self->details->background_surface != NULL) {
+		if (self->details->is_solid) {
+			gdk_window_set_background_rgba (window, &self->details->solid_color);
+		}
+		set_surface_as_root (self, gdk_window_get_screen (window));
+		update_animation (self);
+	}
 }
 
 static gboolean
@@ -266,81 +912,250 @@ fade_to_surface (NautilusDesktopBackground *self,
 		 GdkWindow     *window,
 		 cairo_surface_t *surface)
 {
+	gint64 start;
+
 	if (self->details->fade == NULL) {
 		return FALSE;
 	}
 
-	if (!gnome_bg_crossfade_set_end_surface (self->details->fade,
+	if (!nautilus_background_crossfade_set_end_surface (self->details->fade,
 				                 surface)) {
 		return FALSE;
 	}
 
-	if (!gnome_bg_crossfade_is_started (self->details->fade)) {
-		gnome_bg_crossfade_start (self->details->fade, window);
+	if (!nautilus_background_crossfade_is_started (self->details->fade)) {
+		start = nautilus_background_stats_begin ();
+		nautilus_background_crossfade_start (self->details->fade, window);
+		nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_FADE_START, start);
 		g_signal_connect (self->details->fade,
 				  "finished",
 				  G_CALLBACK (on_fade_finished), self);
 	}
 
-	return gnome_bg_crossfade_is_started (self->details->fade);
+	return nautilus_background_crossfade_is_started (self->details->fade);
 }
 
+/* Puts background_surface on the window and the root window, or
+ * fades to it.
+ */
 static void
-nautilus_desktop_background_set_up_widget (NautilusDesktopBackground *self)
+install_background (NautilusDesktopBackground *self)
 {
 	GdkWindow *window;
 	gboolean in_fade = FALSE;
         GtkWidget *widget;
 
         widget = self->details->widget;
-
-	if (!gtk_widget_get_realized (widget)) {
-		return;
-	}
-
-	nautilus_desktop_background_ensure_realized (self);
-	if (self->details->background_surface == NULL)
-		return;
-
         window = gtk_widget_get_window (widget);
 
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_REPAINTS, 1);
+
 	in_fade = fade_to_surface (self, window,
 				   self->details->background_surface);
 
-	if (!in_fade) {
+	if (self->details->fade_avoided) {
+		self->details->fade_avoided = FALSE;
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_REMOTE_UPDATES_AVOIDED,
+					       nautilus_background_crossfade_get_n_frames ());
+	}
+
+	if (!in_fade && self->details->is_solid) {
+		gdk_window_set_background_rgba (window, &self->details->solid_color);
+
+		set_surface_as_root (self, gtk_widget_get_screen (widget));
+	} else if (!in_fade) {
 		cairo_pattern_t *pattern;
 
 		pattern = cairo_pattern_create_for_surface (self->details->background_surface);
 		gdk_window_set_background_pattern (window, pattern);
 		cairo_pattern_destroy (pattern);
 
-                gnome_bg_set_surface_as_root (gtk_widget_get_screen (widget),
-                                              self->details->background_surface);
+		set_surface_as_root (self, gtk_widget_get_screen (widget));
+	}
+
+	/* A fade shows the first frame, the animation starts after it */
+	if (in_fade) {
+		g_clear_object (&self->details->animation);
+	} else {
+		update_animation (self);
+	}
+}
+
+static void
+nautilus_desktop_background_set_up_widget (NautilusDesktopBackground *self)
+{
+	if (!gtk_widget_get_realized (self->details->widget)) {
+		return;
 	}
+
+	if (!nautilus_desktop_background_ensure_realized (self) ||
+	    self->details->background_surface == NULL)
+		return;
+
+	install_background (self);
 }
 
 static gboolean
 background_changed_cb (NautilusDesktopBackground *self)
 {
+	ChangeFlags changes;
+	gint64 start;
+
+	changes = self->details->pending_changes;
+	self->details->pending_changes = 0;
 	self->details->change_idle_id = 0;
 
-	nautilus_desktop_background_unrealize (self);
-	nautilus_desktop_background_set_up_widget (self);
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_WAKEUPS, 1);
 
-	gtk_widget_queue_draw (self->details->widget);
+	/* Rendering picks up the new settings on its own, the reload
+	 * only keeps our GnomeBG watching the right file. If anything
+	 * changed, it will tell us and we render then.
+	 */
+	if (changes & CHANGE_RELOAD_SETTINGS) {
+		start = nautilus_background_stats_begin ();
+		gnome_bg_load_from_preferences (self->details->bg,
+						gnome_background_preferences);
+		nautilus_background_stats_end (NAUTILUS_BACKGROUND_SPAN_SETTINGS_LOAD, start);
+	}
+
+	if (changes & CHANGE_RENDER) {
+		self->details->content_serial++;
+	}
+	if (changes & CHANGE_GEOMETRY) {
+		self->details->geometry_serial++;
+	}
+
+	if (changes & (CHANGE_RENDER | CHANGE_GEOMETRY) && self->details->widget != NULL) {
+		nautilus_desktop_background_set_up_widget (self);
+
+		gtk_widget_queue_draw (self->details->widget);
+	}
 
 	return FALSE;
 }
 
+/* Settings, GnomeBG and screen events all end up here. Events that
+ * arrive within the debounce interval of each other are handled
+ * together, so a burst of them costs a single reload and render.
+ */
 static void
-queue_background_change (NautilusDesktopBackground *self)
+schedule_change (NautilusDesktopBackground *self,
+		 ChangeFlags changes)
 {
+	nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_WAKEUPS, 1);
+
+	/* Slideshow steps and everything else wait until the desktop
+	 * can be seen again, then are handled together.
+	 */
+	if (is_suspended (self)) {
+		self->details->suspended_changes |= changes;
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_SUSPENDED_EVENTS, 1);
+		return;
+	}
+
 	if (self->details->change_idle_id != 0) {
-                g_source_remove (self->details->change_idle_id);
+		g_source_remove (self->details->change_idle_id);
+		self->details->merged_events++;
+		nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_MERGED_EVENTS, 1);
+		g_object_notify (G_OBJECT (self), "merged-events");
+		g_debug ("Merged background change event, %u so far",
+			 self->details->merged_events);
 	}
 
-	self->details->change_idle_id =
-                g_idle_add ((GSourceFunc) background_changed_cb, self);
+	self->details->pending_changes |= changes;
+
+	if (self->details->debounce_interval == 0) {
+		self->details->change_idle_id =
+			g_idle_add ((GSourceFunc) background_changed_cb, self);
+	} else {
+		self->details->change_idle_id =
+			g_timeout_add (self->details->debounce_interval,
+				       (GSourceFunc) background_changed_cb, self);
+	}
+}
+
+static void
+queue_background_change (NautilusDesktopBackground *self)
+{
+	schedule_change (self, CHANGE_RENDER);
+}
+
+static void
+on_suspended_changed (NautilusBackgroundActivity *activity,
+		      GParamSpec *pspec,
+		      NautilusDesktopBackground *self)
+{
+	ChangeFlags changes;
+
+	if (self->details->animation != NULL) {
+		nautilus_background_animation_set_paused (self->details->animation,
+							  nautilus_background_activity_is_suspended (activity));
+	}
+
+	if (nautilus_background_activity_is_suspended (activity)) {
+		/* Jump to the end of a running fade */
+		if (self->details->fade != NULL &&
+		    nautilus_background_crossfade_is_started (self->details->fade)) {
+			nautilus_background_crossfade_stop (self->details->fade);
+		}
+		free_fade (self);
+
+		if (self->details->change_idle_id != 0) {
+			g_source_remove (self->details->change_idle_id);
+			self->details->change_idle_id = 0;
+			self->details->suspended_changes |= self->details->pending_changes;
+			self->details->pending_changes = 0;
+		}
+		return;
+	}
+
+	changes = self->details->suspended_changes;
+	self->details->suspended_changes = 0;
+	if (changes != 0) {
+		schedule_change (self, changes);
+	}
+}
+
+/* Gives memory back a step at a time. What is on the X server stays
+ * up; anything dropped here is rebuilt by the next change.
+ */
+static void
+on_memory_pressure (NautilusBackgroundPressure *pressure,
+		    NautilusBackgroundPressureLevel level,
+		    NautilusDesktopBackground *self)
+{
+	guint64 resident;
+
+	resident = get_resident_bytes ();
+
+	nautilus_background_render_release_caches ();
+
+	self->details->releasing_memory = TRUE;
+
+	/* A fade holds up to three screen-sized images, an animation
+	 * its ring of frames. The fade goes first: its end installs
+	 * what is there, and nothing else while releasing_memory is set.
+	 */
+	if (level >= NAUTILUS_BACKGROUND_PRESSURE_MEDIUM) {
+		if (self->details->fade != NULL &&
+		    nautilus_background_crossfade_is_started (self->details->fade)) {
+			nautilus_background_crossfade_stop (self->details->fade);
+		}
+		free_fade (self);
+		stop_animation (self);
+		cancel_preview (self);
+	}
+
+	if (level >= NAUTILUS_BACKGROUND_PRESSURE_CRITICAL &&
+	    self->details->render_cancellable != NULL) {
+		cancel_render (self);
+		g_object_notify (G_OBJECT (self), "rendering");
+	}
+
+	self->details->releasing_memory = FALSE;
+
+	g_debug ("Released background memory at level %d, %" G_GUINT64_FORMAT " bytes resident before",
+		 level, resident);
 }
 
 static void
@@ -354,6 +1169,15 @@ nautilus_desktop_background_changed (GnomeBG *bg,
 	queue_background_change (self);
 }
 
+static gboolean
+transition_settled_cb (NautilusDesktopBackground *self)
+{
+	self->details->transition_settle_id = 0;
+	queue_background_change (self);
+
+	return FALSE;
+}
+
 static void
 nautilus_desktop_background_transitioned (GnomeBG *bg,
                                           gpointer user_data)
@@ -362,6 +1186,21 @@ nautilus_desktop_background_transitioned (GnomeBG *bg,
 
         self = user_data;
 	free_fade (self);
+
+	/* Each step of a slideshow transition would be a full-screen
+	 * update. Remote displays only get the slide it ends on.
+	 */
+	if (self->details->remote) {
+		if (self->details->transition_settle_id != 0) {
+			g_source_remove (self->details->transition_settle_id);
+			nautilus_background_stats_add (NAUTILUS_BACKGROUND_COUNTER_REMOTE_UPDATES_AVOIDED, 1);
+		}
+		self->details->transition_settle_id =
+			g_timeout_add (REMOTE_TRANSITION_SETTLE,
+				       (GSourceFunc) transition_settled_cb, self);
+		return;
+	}
+
 	queue_background_change (self);
 }
 
@@ -400,6 +1239,9 @@ widget_unrealize_cb (GtkWidget *widget,
 {
         NautilusDesktopBackground *self = user_data;
 
+	/* It holds on to the window */
+	g_clear_object (&self->details->animation);
+
 	if (self->details->screen_size_handler > 0) {
 		        g_signal_handler_disconnect (gtk_widget_get_screen (GTK_WIDGET (widget)),
 				                     self->details->screen_size_handler);
@@ -422,22 +1264,21 @@ on_widget_destroyed (GtkWidget *widget,
 		g_source_remove (self->details->change_idle_id);
 		self->details->change_idle_id = 0;
 	}
+	if (self->details->transition_settle_id != 0) {
+		g_source_remove (self->details->transition_settle_id);
+		self->details->transition_settle_id = 0;
+	}
 
+	/* Before the display goes, which happens right after the
+	 * window when a server is lost
+	 */
+	cancel_render (self);
 	free_fade (self);
+	g_clear_object (&self->details->animation);
+	free_background_surface (self);
 	self->details->widget = NULL;
 }
 
-static gboolean
-background_change_event_idle_cb (NautilusDesktopBackground *self)
-{
-	gnome_bg_load_from_preferences (self->details->bg,
-					gnome_background_preferences);
-
-	g_object_unref (self);
-
-	return FALSE;
-}
-
 static gboolean
 background_settings_change_event_cb (GSettings *settings,
                                      gpointer   keys,
@@ -449,8 +1290,7 @@ background_settings_change_event_cb (GSettings *settings,
 	/* Need to defer signal processing otherwise
 	 * we would make the dconf backend deadlock.
 	 */
-	g_idle_add ((GSourceFunc) background_change_event_idle_cb,
-		    g_object_ref (self));
+	schedule_change (self, CHANGE_RELOAD_SETTINGS);
 
 	return FALSE;
 }
@@ -478,6 +1318,12 @@ nautilus_desktop_background_constructed (GObject *obj)
 	g_signal_connect_object (widget, "unrealize",
 				 G_CALLBACK (widget_unrealize_cb), self, 0);
 
+	self->details->activity = nautilus_background_activity_new (widget);
+	g_signal_connect (self->details->activity, "notify::suspended",
+			  G_CALLBACK (on_suspended_changed), self);
+	g_signal_connect (nautilus_background_pressure_get_default (), "memory-pressure",
+			  G_CALLBACK (on_memory_pressure), self);
+
         gnome_bg_load_from_preferences (self->details->bg,
                                         gnome_background_preferences);
 
@@ -487,7 +1333,10 @@ nautilus_desktop_background_constructed (GObject *obj)
                           G_CALLBACK (background_settings_change_event_cb),
                           self);
 
-	queue_background_change (self);
+	/* Otherwise it is set up once it gets realized */
+	if (gtk_widget_get_realized (widget)) {
+		nautilus_desktop_background_set_up_widget (self);
+	}
 }
 
 static void
@@ -504,6 +1353,67 @@ nautilus_desktop_background_set_property (GObject *object,
         case PROP_WIDGET:
                 self->details->widget = g_value_get_object (value);
                 break;
+        case PROP_DEBOUNCE_INTERVAL:
+                self->details->debounce_interval = g_value_get_uint (value);
+                break;
+        case PROP_USE_XRENDER:
+                self->details->use_xrender = g_value_get_boolean (value);
+                break;
+        case PROP_LOW_MEMORY:
+                self->details->low_memory = g_value_get_boolean (value);
+                nautilus_background_render_set_low_memory (self->details->low_memory);
+                if (self->details->low_memory) {
+                        stop_animation (self);
+                }
+                break;
+        case PROP_REMOTE:
+                self->details->remote = g_value_get_boolean (value);
+                if (self->details->remote) {
+                        free_fade (self);
+                        stop_animation (self);
+                }
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+                break;
+        }
+}
+
+static void
+nautilus_desktop_background_get_property (GObject *object,
+                                          guint property_id,
+                                          GValue *value,
+                                          GParamSpec *pspec)
+{
+        NautilusDesktopBackground *self;
+
+        self = NAUTILUS_DESKTOP_BACKGROUND (object);
+
+        switch (property_id) {
+        case PROP_DEBOUNCE_INTERVAL:
+                g_value_set_uint (value, self->details->debounce_interval);
+                break;
+        case PROP_MERGED_EVENTS:
+                g_value_set_uint (value, self->details->merged_events);
+                break;
+        case PROP_USE_XRENDER:
+                g_value_set_boolean (value, self->details->use_xrender);
+                break;
+        case PROP_BYTES_SENT:
+                g_value_set_uint64 (value, nautilus_background_render_get_bytes_sent ());
+                break;
+        case PROP_LOW_MEMORY:
+                g_value_set_boolean (value, self->details->low_memory);
+                break;
+        case PROP_RESIDENT_BYTES:
+                g_value_set_uint64 (value, get_resident_bytes ());
+                break;
+        case PROP_RENDERING:
+                g_value_set_boolean (value, self->details->render_cancellable != NULL);
+                break;
+        case PROP_REMOTE:
+                g_value_set_boolean (value, self->details->remote);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -516,16 +1426,32 @@ nautilus_desktop_background_constructor (GType type,
                                          GObjectConstructParam *construct_params)
 {
         GObject *retval;
+        GtkWidget *widget = NULL;
+        GdkScreen *screen;
+        guint i;
+
+        for (i = 0; i < n_construct_params; i++) {
+                if (g_strcmp0 (construct_params[i].pspec->name, "widget") == 0) {
+                        widget = g_value_get_object (construct_params[i].value);
+                }
+        }
+        g_return_val_if_fail (widget != NULL, NULL);
 
-        if (singleton != NULL) {
-                return g_object_ref (singleton);
+        if (instances == NULL) {
+                instances = g_hash_table_new (NULL, NULL);
+        }
+
+        screen = gtk_widget_get_screen (widget);
+        retval = g_hash_table_lookup (instances, screen);
+        if (retval != NULL) {
+                return g_object_ref (retval);
         }
 
         retval = G_OBJECT_CLASS (nautilus_desktop_background_parent_class)->constructor
                 (type, n_construct_params, construct_params);
 
-        singleton = NAUTILUS_DESKTOP_BACKGROUND (retval);
-        g_object_add_weak_pointer (retval, (gpointer) &singleton);
+        NAUTILUS_DESKTOP_BACKGROUND (retval)->details->screen = g_object_ref (screen);
+        g_hash_table_insert (instances, screen, retval);
 
         return retval;
 }
@@ -542,6 +1468,7 @@ nautilus_desktop_background_class_init (NautilusDesktopBackgroundClass *klass)
 	object_class = G_OBJECT_CLASS (klass);
 	object_class->finalize = nautilus_desktop_background_finalize;
         object_class->set_property = nautilus_desktop_background_set_property;
+        object_class->get_property = nautilus_desktop_background_get_property;
         object_class->constructor = nautilus_desktop_background_constructor;
         object_class->constructed = nautilus_desktop_background_constructed;
 
@@ -551,6 +1478,54 @@ nautilus_desktop_background_class_init (NautilusDesktopBackgroundClass *klass)
                                      G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
         g_object_class_install_property (object_class, PROP_WIDGET, pspec);
 
+        pspec = g_param_spec_uint ("debounce-interval", "Debounce interval",
+                                   "Milliseconds to wait for more change events before acting on them",
+                                   0, G_MAXUINT, DEFAULT_DEBOUNCE_INTERVAL,
+                                   G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_DEBOUNCE_INTERVAL, pspec);
+
+        pspec = g_param_spec_uint ("merged-events", "Merged events",
+                                   "Number of change events handled together with another one",
+                                   0, G_MAXUINT, 0,
+                                   G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_MERGED_EVENTS, pspec);
+
+        pspec = g_param_spec_boolean ("use-xrender", "Use XRender",
+                                      "Whether crossfades are composited on the X server",
+                                      FALSE,
+                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_USE_XRENDER, pspec);
+
+        pspec = g_param_spec_uint64 ("bytes-sent", "Bytes sent",
+                                     "Background pixel data written to the X socket, as opposed to shared memory",
+                                     0, G_MAXUINT64, 0,
+                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_BYTES_SENT, pspec);
+
+        pspec = g_param_spec_boolean ("low-memory", "Low memory",
+                                      "Whether to keep nothing on the client that is already on the X server",
+                                      FALSE,
+                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_LOW_MEMORY, pspec);
+
+        pspec = g_param_spec_uint64 ("resident-bytes", "Resident bytes",
+                                     "Resident set size of this process",
+                                     0, G_MAXUINT64, 0,
+                                     G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_RESIDENT_BYTES, pspec);
+
+        pspec = g_param_spec_boolean ("rendering", "Rendering",
+                                      "Whether a new background is being rendered",
+                                      FALSE,
+                                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_RENDERING, pspec);
+
+        pspec = g_param_spec_boolean ("remote", "Remote",
+                                      "Whether the display is sent over the network, so that repaints are expensive",
+                                      FALSE,
+                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+        g_object_class_install_property (object_class, PROP_REMOTE, pspec);
+
 	g_type_class_add_private (klass, sizeof (NautilusDesktopBackgroundDetails));
 }
 
@@ -563,6 +1538,7 @@ nautilus_desktop_background_init (NautilusDesktopBackground *self)
 					     NautilusDesktopBackgroundDetails);
 
         self->details->bg = gnome_bg_new ();
+	self->details->debounce_interval = DEFAULT_DEBOUNCE_INTERVAL;
 	self->details->default_color.red = 0xffff;
 	self->details->default_color.green = 0xffff;
 	self->details->default_color.blue = 0xffff;
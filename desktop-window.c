@@ -176,9 +176,12 @@ realize (GtkWidget *widget)
 	window = NAUTILUS_DESKTOP_WINDOW (widget);
 	details = window->details;
 
-	/* Make sure we get keyboard events */
+	/* Make sure we get keyboard events, and learn when we are
+	 * covered up so the background can stop animating
+	 */
 	gtk_widget_set_events (widget, gtk_widget_get_events (widget) 
-			      | GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK);
+			      | GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK
+			      | GDK_VISIBILITY_NOTIFY_MASK);
 			      
 	/* Do the work of realizing. */
 	GTK_WIDGET_CLASS (nautilus_desktop_window_parent_class)->realize (widget);
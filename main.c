@@ -26,14 +26,199 @@
 
 #include "desktop-background.h"
 #include "desktop-window.h"
+#include "background-cache.h"
+#include "background-remote.h"
+#include "background-stats.h"
 
-int main(int argc, char** argv)
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+
+static gint debounce_interval = -1;
+static gboolean use_xrender = FALSE;
+static gboolean low_memory = FALSE;
+static gboolean stats = FALSE;
+static gchar **serve_displays = NULL;
+static gchar *shared_store = NULL;
+static gchar *remote = NULL;
+
+static GOptionEntry entries[] = {
+	{ "debounce-interval", 0, 0, G_OPTION_ARG_INT, &debounce_interval,
+	  "Milliseconds to wait for more change events before redrawing", "MS" },
+	{ "xrender", 0, 0, G_OPTION_ARG_NONE, &use_xrender,
+	  "Composite crossfades on the X server", NULL },
+	{ "low-memory", 0, 0, G_OPTION_ARG_NONE, &low_memory,
+	  "Keep only the server-side copy of the background", NULL },
+	{ "stats", 0, 0, G_OPTION_ARG_NONE, &stats,
+	  "Print timing histograms and counters on SIGUSR1", NULL },
+	{ "shared-store", 0, 0, G_OPTION_ARG_STRING, &shared_store,
+	  "Share rendered backgrounds in memory with other sessions of this user or of all users", "user|system" },
+	{ "remote", 0, 0, G_OPTION_ARG_STRING, &remote,
+	  "Whether displays are sent over the network, e.g. by VNC: no crossfades, few colours; detected by default", "auto|yes|no" },
+	{ "serve", 0, 0, G_OPTION_ARG_STRING_ARRAY, &serve_displays,
+	  "Serve this X display; may be given more than once", "DISPLAY" },
+	{ NULL }
+};
+
+/* Displays still being served */
+static guint n_displays = 0;
+
+static void
+on_display_closed (GdkDisplay *display,
+		   gboolean is_error,
+		   GList *desktops)
+{
+	g_list_free_full (desktops, (GDestroyNotify) gtk_widget_destroy);
+
+	if (--n_displays == 0) {
+		gtk_main_quit ();
+	}
+}
+
+/* GDK's handler exits the process when any connection is lost,
+ * taking every other display down with it. Only the display that
+ * went away is closed instead.
+ */
+static int
+on_io_error (Display *xdisplay)
+{
+	g_warning ("Lost the connection to display %s", DisplayString (xdisplay));
+
+	return 0;
+}
+
+static gboolean
+close_display_cb (gpointer data)
+{
+	gdk_display_close (data);
+
+	return FALSE;
+}
+
+/* Xlib is still inside the call that failed, so the display is
+ * closed from the main loop. Every later call fails the same way.
+ */
+static void
+on_io_error_exit (Display *xdisplay,
+		  void *user_data)
+{
+	GdkDisplay *display = user_data;
+
+	if (g_object_get_data (G_OBJECT (display), "io-error") != NULL)
+		return;
+
+	g_object_set_data (G_OBJECT (display), "io-error", GINT_TO_POINTER (TRUE));
+	g_idle_add_full (G_PRIORITY_HIGH, close_display_cb, display, NULL);
+}
+
+static void
+serve_screen (GdkScreen *screen,
+	      gboolean is_remote,
+	      GList **desktops)
 {
-	gtk_init(&argc, &argv);
-	GdkScreen* screen = gdk_screen_get_default ();
 	GtkWidget* desktop = nautilus_desktop_window_new (screen);
-	/*NautilusDesktopBackground* background = */nautilus_desktop_background_new (desktop);
+	NautilusDesktopBackground* background = nautilus_desktop_background_new (desktop);
+	if (debounce_interval >= 0)
+		g_object_set (background, "debounce-interval", (guint) debounce_interval, NULL);
+	g_object_set (background, "use-xrender", use_xrender, NULL);
+	g_object_set (background, "low-memory", low_memory, NULL);
+	g_object_set (background, "remote", is_remote, NULL);
 	gtk_widget_show (desktop);
+
+	/* The background goes with the window */
+	g_object_weak_ref (G_OBJECT (desktop), (GWeakNotify) g_object_unref, background);
+	*desktops = g_list_prepend (*desktops, desktop);
+}
+
+/* Every screen of @name gets its own window and background. The
+ * caches behind them are shared, so displays showing the same
+ * picture decode it once.
+ */
+static gboolean
+serve_display (const char *name)
+{
+	GdkDisplay *display;
+	GList *desktops = NULL;
+	const char *reason;
+	gboolean is_remote;
+	int i;
+
+	display = gdk_display_open (name);
+	if (display == NULL) {
+		g_printerr ("Cannot open display %s\n", name ? name : "(default)");
+		return FALSE;
+	}
+
+	if (gdk_display_get_default () == NULL)
+		gdk_display_manager_set_default_display (gdk_display_manager_get (), display);
+
+	XSetIOErrorHandler (on_io_error);
+	XSetIOErrorExitHandler (GDK_DISPLAY_XDISPLAY (display), on_io_error_exit, display);
+
+	if (g_strcmp0 (remote, "yes") == 0) {
+		is_remote = TRUE;
+	} else if (g_strcmp0 (remote, "no") == 0) {
+		is_remote = FALSE;
+	} else {
+		reason = nautilus_background_remote_detect (display);
+		if (reason != NULL)
+			g_debug ("Display %s looks remote: %s", gdk_display_get_name (display), reason);
+		is_remote = reason != NULL;
+	}
+
+	for (i = 0; i < gdk_display_get_n_screens (display); i++)
+		serve_screen (gdk_display_get_screen (display, i), is_remote, &desktops);
+
+	g_signal_connect (display, "closed", G_CALLBACK (on_display_closed), desktops);
+	n_displays++;
+
+	return TRUE;
+}
+
+int main(int argc, char** argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	int i;
+
+	/* Displays are opened below, there may be several */
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (stats)
+		nautilus_background_stats_dump_on_signal ();
+
+	if (g_strcmp0 (shared_store, "user") == 0) {
+		nautilus_background_cache_set_shared_store (NAUTILUS_BACKGROUND_SHARED_STORE_USER);
+	} else if (g_strcmp0 (shared_store, "system") == 0) {
+		nautilus_background_cache_set_shared_store (NAUTILUS_BACKGROUND_SHARED_STORE_SYSTEM);
+	} else if (shared_store != NULL) {
+		g_printerr ("Unknown shared store '%s', expected user or system\n", shared_store);
+		return 1;
+	}
+
+	if (remote != NULL && g_strcmp0 (remote, "auto") != 0 &&
+	    g_strcmp0 (remote, "yes") != 0 && g_strcmp0 (remote, "no") != 0) {
+		g_printerr ("Unknown remote setting '%s', expected auto, yes or no\n", remote);
+		return 1;
+	}
+
+	if (serve_displays == NULL) {
+		serve_display (gdk_get_display_arg_name ());
+	} else {
+		for (i = 0; serve_displays[i] != NULL; i++)
+			serve_display (serve_displays[i]);
+	}
+
+	if (n_displays == 0)
+		return 1;
+
 	gtk_main();
 	return 0;
 }